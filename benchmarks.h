@@ -0,0 +1,129 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "shader.h"
+#include "sphere.h"
+#include "instancedRenderer.h"
+#include "normalMatrix.h"
+
+// Vertex-stage cost of the normal matrix on a high-instance-count scene:
+// the old per-vertex mat3(transpose(inverse(model))) against a per-instance
+// matrix computed once on the CPU. Rasterization is discarded so only the
+// vertex stage is timed (GL_TIME_ELAPSED).
+inline void runNormalMatrixBenchmark(int instanceCount = 20000, int frames = 50, int cpuRepeats = 21)
+{
+    std::vector<float> sphereVertices;
+    std::vector<unsigned int> sphereIndices;
+    generateSphere(1.0f, 36, 18, sphereVertices, sphereIndices); // ~700 vertices
+    MeshBuffer sphere(sphereVertices, sphereIndices);
+    InstancedRenderer batch(sphere);
+
+    // a grid of rotated, non-uniformly scaled spheres
+    std::vector<glm::mat4> models;
+    models.reserve(instanceCount);
+    int side = 1;
+    while (side * side < instanceCount)
+        ++side;
+    batch.begin();
+    for (int i = 0; i < instanceCount; ++i)
+    {
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3((i % side) - side / 2.0f, 0.0f, (i / side) - side / 2.0f));
+        model = glm::rotate(model, glm::radians(7.0f * i), glm::vec3(0.3f, 1.0f, 0.2f));
+        model = glm::scale(model, glm::vec3(0.2f + 0.1f * (i % 3), 0.3f, 0.25f));
+        models.push_back(model);
+        batch.add(model, 0);
+    }
+    batch.upload(GL_STATIC_DRAW);
+
+    // CPU side: fast path vs. general inverse-transpose for the same matrices.
+    // After a warmup pass of each, both run cpuRepeats times, taking turns at
+    // going first, and the median time of each is reported.
+    float checksum = 0.0f; // keeps the optimizer from dropping the loops
+    std::vector<double> cpuMs[2]; // [0] fast path, [1] full inverse
+    for (int repeat = -1; repeat < cpuRepeats; ++repeat)
+    {
+        for (int turn = 0; turn < 2; ++turn)
+        {
+            int path = (turn + repeat + 1) % 2;
+            auto cpuStart = std::chrono::high_resolution_clock::now();
+            if (path == 0)
+                for (const glm::mat4& model : models)
+                    checksum += computeNormalMatrix(model)[1][1];
+            else
+                for (const glm::mat4& model : models)
+                    checksum -= glm::transpose(glm::inverse(glm::mat3(model)))[1][1];
+            auto cpuEnd = std::chrono::high_resolution_clock::now();
+            if (repeat >= 0)
+                cpuMs[path].push_back(std::chrono::duration<double, std::milli>(cpuEnd - cpuStart).count());
+        }
+    }
+    for (std::vector<double>& times : cpuMs)
+        std::sort(times.begin(), times.end());
+    double cpuFastMs = cpuMs[0][cpuMs[0].size() / 2];
+    double cpuFullMs = cpuMs[1][cpuMs[1].size() / 2];
+
+    Shader shader("normalMatrixBenchmark.vs", "normalMatrixBenchmark.fs");
+    Uniform<glm::mat4> view = shader.uniform<glm::mat4>("view");
+    Uniform<glm::mat4> projection = shader.uniform<glm::mat4>("projection");
+    Uniform<bool> perVertexInverse = shader.uniform<bool>("perVertexInverse");
+
+    shader.use();
+    shader.set(view, glm::lookAt(glm::vec3(0.0f, side * 0.5f, side * 0.75f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+    shader.set(projection, glm::perspective(glm::radians(45.0f), 1.25f, 0.1f, 1000.0f));
+
+    GLuint query;
+    glGenQueries(1, &query);
+    glEnable(GL_RASTERIZER_DISCARD);
+
+    // GPU timer queries plus glFinish-bracketed wall time, since software
+    // rasterizers (llvmpipe) don't report meaningful GL_TIME_ELAPSED values
+    double gpuMs[2] = { 0.0, 0.0 };
+    double wallMs[2] = { 0.0, 0.0 };
+    for (int mode = 0; mode < 2; ++mode)
+    {
+        shader.set(perVertexInverse, mode == 0);
+        for (int warmup = 0; warmup < 5; ++warmup)
+            batch.draw();
+        glFinish();
+
+        GLuint64 total = 0;
+        auto wallStart = std::chrono::high_resolution_clock::now();
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            glBeginQuery(GL_TIME_ELAPSED, query);
+            batch.draw();
+            glEndQuery(GL_TIME_ELAPSED);
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+            total += elapsed;
+        }
+        glFinish();
+        auto wallEnd = std::chrono::high_resolution_clock::now();
+        gpuMs[mode] = total / 1.0e6 / frames;
+        wallMs[mode] = std::chrono::duration<double, std::milli>(wallEnd - wallStart).count() / frames;
+    }
+
+    glDisable(GL_RASTERIZER_DISCARD);
+    glDeleteQueries(1, &query);
+
+    size_t vertices = sphereVertices.size() / 6;
+
+    std::cout << "Normal matrix benchmark: " << instanceCount << " instances x " << vertices << " vertices, " << frames << " frames" << std::endl;
+    std::cout << "  vertex stage, inverse per vertex : GPU " << gpuMs[0] << " ms, wall " << wallMs[0] << " ms per frame" << std::endl;
+    std::cout << "  vertex stage, per-instance matrix: GPU " << gpuMs[1] << " ms, wall " << wallMs[1] << " ms per frame" << std::endl;
+    if (gpuMs[1] > 0.0 && wallMs[1] > 0.0)
+        std::cout << "  speedup: GPU " << gpuMs[0] / gpuMs[1] << "x, wall " << wallMs[0] / wallMs[1] << "x" << std::endl;
+    std::cout << "  CPU, " << instanceCount << " normal matrices, median of " << cpuRepeats << ": fast path " << cpuFastMs << " ms, full inverse "
+              << cpuFullMs << " ms (checksum " << checksum << ")" << std::endl;
+}
+
+#endif
@@ -0,0 +1,333 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+// Axis-aligned bounding box
+struct AABB
+{
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    // world bounds of the unit cube [-0.5, 0.5]^3 transformed by model
+    static AABB fromUnitCube(const glm::mat4& model)
+    {
+        glm::vec3 center(model[3]);
+        glm::vec3 extent = 0.5f * (glm::abs(glm::vec3(model[0])) + glm::abs(glm::vec3(model[1])) + glm::abs(glm::vec3(model[2])));
+        AABB box;
+        box.min = center - extent;
+        box.max = center + extent;
+        return box;
+    }
+
+    void grow(const AABB& other)
+    {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    void grow(const glm::vec3& point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    bool isEmpty() const
+    {
+        return min.x > max.x;
+    }
+
+    glm::vec3 center() const
+    {
+        return 0.5f * (min + max);
+    }
+
+    float surfaceArea() const
+    {
+        if (isEmpty())
+            return 0.0f;
+        glm::vec3 size = max - min;
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+};
+
+// The six clip planes of a view-projection matrix, pointing inwards
+struct Frustum
+{
+    enum Result { OUTSIDE, INTERSECTS, INSIDE };
+
+    glm::vec4 planes[6]; // xyz = normal, w = distance
+
+    // Gribb/Hartmann plane extraction from projection * view
+    static Frustum fromMatrix(const glm::mat4& m)
+    {
+        glm::vec4 row[4];
+        for (int i = 0; i < 4; ++i)
+            row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+        Frustum frustum;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            frustum.planes[2 * axis] = row[3] + row[axis];
+            frustum.planes[2 * axis + 1] = row[3] - row[axis];
+        }
+        for (glm::vec4& plane : frustum.planes)
+            plane = plane / glm::length(glm::vec3(plane));
+        return frustum;
+    }
+
+    // planeMask has a bit set for every plane the box still has to be tested
+    // against; planes the box is fully inside of are cleared for its children
+    Result classify(const AABB& box, unsigned int& planeMask) const
+    {
+        for (int i = 0; i < 6; ++i)
+        {
+            if (!(planeMask & (1u << i)))
+                continue;
+            const glm::vec4& plane = planes[i];
+            glm::vec3 normal(plane);
+            // corner furthest along the normal, and the one furthest against it
+            glm::vec3 positive(normal.x >= 0.0f ? box.max.x : box.min.x, normal.y >= 0.0f ? box.max.y : box.min.y, normal.z >= 0.0f ? box.max.z : box.min.z);
+            glm::vec3 negative(normal.x >= 0.0f ? box.min.x : box.max.x, normal.y >= 0.0f ? box.min.y : box.max.y, normal.z >= 0.0f ? box.min.z : box.max.z);
+            if (glm::dot(normal, positive) + plane.w < 0.0f)
+                return OUTSIDE;
+            if (glm::dot(normal, negative) + plane.w >= 0.0f)
+                planeMask &= ~(1u << i);
+        }
+        return planeMask == 0 ? INSIDE : INTERSECTS;
+    }
+};
+
+struct CullStats
+{
+    int visible = 0;
+    int culled = 0;
+    int nodesTested = 0;
+};
+
+// Bounding volume hierarchy over a fixed set of primitives (scene objects),
+// built once with the surface area heuristic. Moving primitives are handled
+// by refitting the boxes on their path to the root rather than rebuilding.
+// Every node covers a contiguous range of the primitive order, so a subtree
+// that is entirely inside the frustum is accepted without further tests.
+class BVH
+{
+public:
+    struct Node
+    {
+        AABB bounds;
+        int left = -1;  // children, -1 for leaves
+        int right = -1;
+        int parent = -1;
+        int first = 0;  // range in primitiveOrder
+        int count = 0;
+    };
+
+    static const int MAX_LEAF_SIZE = 4;
+    static const int SAH_BINS = 12;
+
+    void build(const std::vector<AABB>& primitiveBounds)
+    {
+        bounds = primitiveBounds;
+        int primitiveCount = static_cast<int>(bounds.size());
+        primitiveOrder.resize(primitiveCount);
+        for (int i = 0; i < primitiveCount; ++i)
+            primitiveOrder[i] = i;
+        centers.resize(primitiveCount);
+        for (int i = 0; i < primitiveCount; ++i)
+            centers[i] = bounds[i].center();
+
+        nodes.clear();
+        nodes.reserve(2 * primitiveCount);
+        if (primitiveCount == 0)
+            return;
+        Node root;
+        root.count = primitiveCount;
+        nodes.push_back(root);
+        subdivide(0);
+
+        leafOf.assign(primitiveCount, -1);
+        for (int n = 0; n < static_cast<int>(nodes.size()); ++n)
+            if (nodes[n].left < 0)
+                for (int i = nodes[n].first; i < nodes[n].first + nodes[n].count; ++i)
+                    leafOf[primitiveOrder[i]] = n;
+    }
+
+    // move one primitive and grow/shrink the boxes above it
+    void refit(int primitive, const AABB& primitiveBounds)
+    {
+        bounds[primitive] = primitiveBounds;
+        int n = leafOf[primitive];
+        nodes[n].bounds = rangeBounds(nodes[n].first, nodes[n].count);
+        for (n = nodes[n].parent; n >= 0; n = nodes[n].parent)
+        {
+            AABB box = nodes[nodes[n].left].bounds;
+            box.grow(nodes[nodes[n].right].bounds);
+            nodes[n].bounds = box;
+        }
+    }
+
+    // append the primitives that intersect the frustum, in ascending order
+    void cull(const Frustum& frustum, std::vector<int>& visible, CullStats& stats) const
+    {
+        visible.clear();
+        stats = CullStats();
+        if (nodes.empty())
+            return;
+
+        struct Entry { int node; unsigned int planeMask; };
+        std::vector<Entry> stack;
+        stack.reserve(64);
+        stack.push_back({ 0, 0x3Fu });
+        while (!stack.empty())
+        {
+            Entry entry = stack.back();
+            stack.pop_back();
+            const Node& node = nodes[entry.node];
+            ++stats.nodesTested;
+            Frustum::Result result = frustum.classify(node.bounds, entry.planeMask);
+            if (result == Frustum::OUTSIDE)
+                continue;
+            if (result == Frustum::INSIDE || node.left < 0)
+            {
+                // primitives of a leaf that straddles the frustum are tested one by one
+                for (int i = node.first; i < node.first + node.count; ++i)
+                {
+                    unsigned int mask = entry.planeMask;
+                    if (result == Frustum::INSIDE || frustum.classify(bounds[primitiveOrder[i]], mask) != Frustum::OUTSIDE)
+                        visible.push_back(primitiveOrder[i]);
+                }
+                continue;
+            }
+            stack.push_back({ node.right, entry.planeMask });
+            stack.push_back({ node.left, entry.planeMask });
+        }
+
+        // keep the scene's submission order so the image doesn't depend on the tree
+        std::sort(visible.begin(), visible.end());
+        stats.visible = static_cast<int>(visible.size());
+        stats.culled = static_cast<int>(bounds.size()) - stats.visible;
+    }
+
+    int primitiveCount() const
+    {
+        return static_cast<int>(bounds.size());
+    }
+
+    const std::vector<Node>& treeNodes() const
+    {
+        return nodes;
+    }
+
+private:
+    std::vector<Node> nodes;
+    std::vector<AABB> bounds;
+    std::vector<glm::vec3> centers;
+    std::vector<int> primitiveOrder;
+    std::vector<int> leafOf;
+
+    AABB rangeBounds(int first, int count) const
+    {
+        AABB box;
+        for (int i = first; i < first + count; ++i)
+            box.grow(bounds[primitiveOrder[i]]);
+        return box;
+    }
+
+    // binned SAH: try SAH_BINS - 1 split planes on each axis and keep the
+    // cheapest, unless leaving the node as a leaf is cheaper
+    void subdivide(int nodeIndex)
+    {
+        int first = nodes[nodeIndex].first;
+        int count = nodes[nodeIndex].count;
+        nodes[nodeIndex].bounds = rangeBounds(first, count);
+        if (count <= 1)
+            return;
+
+        AABB centerBounds;
+        for (int i = first; i < first + count; ++i)
+            centerBounds.grow(centers[primitiveOrder[i]]);
+
+        int bestAxis = -1;
+        int bestSplit = 0;
+        float bestCost = FLT_MAX;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float lo = centerBounds.min[axis], hi = centerBounds.max[axis];
+            if (hi <= lo)
+                continue;
+
+            AABB binBounds[SAH_BINS];
+            int binCounts[SAH_BINS] = {};
+            float scale = SAH_BINS / (hi - lo);
+            for (int i = first; i < first + count; ++i)
+            {
+                int p = primitiveOrder[i];
+                int bin = std::min(SAH_BINS - 1, static_cast<int>((centers[p][axis] - lo) * scale));
+                binCounts[bin]++;
+                binBounds[bin].grow(bounds[p]);
+            }
+
+            // sweep from both sides to get the area and count left/right of every plane
+            float leftArea[SAH_BINS - 1], rightArea[SAH_BINS - 1];
+            int leftCount[SAH_BINS - 1], rightCount[SAH_BINS - 1];
+            AABB leftBox, rightBox;
+            int leftSum = 0, rightSum = 0;
+            for (int i = 0; i < SAH_BINS - 1; ++i)
+            {
+                leftSum += binCounts[i];
+                leftBox.grow(binBounds[i]);
+                leftCount[i] = leftSum;
+                leftArea[i] = leftBox.surfaceArea();
+
+                rightSum += binCounts[SAH_BINS - 1 - i];
+                rightBox.grow(binBounds[SAH_BINS - 1 - i]);
+                rightCount[SAH_BINS - 2 - i] = rightSum;
+                rightArea[SAH_BINS - 2 - i] = rightBox.surfaceArea();
+            }
+            for (int i = 0; i < SAH_BINS - 1; ++i)
+            {
+                if (leftCount[i] == 0 || rightCount[i] == 0)
+                    continue;
+                float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i;
+                }
+            }
+        }
+
+        // relative traversal cost of 1 per node vs 1 per primitive test
+        float leafCost = count * nodes[nodeIndex].bounds.surfaceArea();
+        float splitCost = nodes[nodeIndex].bounds.surfaceArea() + bestCost;
+        if (bestAxis < 0 || (count <= MAX_LEAF_SIZE && splitCost >= leafCost))
+            return;
+
+        float lo = centerBounds.min[bestAxis];
+        float scale = SAH_BINS / (centerBounds.max[bestAxis] - lo);
+        std::vector<int>::iterator middle = std::partition(primitiveOrder.begin() + first, primitiveOrder.begin() + first + count,
+            [&](int p) { return std::min(SAH_BINS - 1, static_cast<int>((centers[p][bestAxis] - lo) * scale)) <= bestSplit; });
+        int leftCount = static_cast<int>(middle - (primitiveOrder.begin() + first));
+
+        Node left, right;
+        left.parent = right.parent = nodeIndex;
+        left.first = first;
+        left.count = leftCount;
+        right.first = first + leftCount;
+        right.count = count - leftCount;
+        int leftIndex = static_cast<int>(nodes.size());
+        nodes.push_back(left);
+        nodes.push_back(right);
+        nodes[nodeIndex].left = leftIndex;
+        nodes[nodeIndex].right = leftIndex + 1;
+        subdivide(leftIndex);
+        subdivide(leftIndex + 1);
+    }
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "camera.h"
+
+// A scripted camera flight through keyframes, for reproducible benchmark
+// runs. Position, yaw and pitch are eased between consecutive keys.
+class CameraPath
+{
+public:
+    struct Key
+    {
+        float time; // seconds from the start of the path
+        glm::vec3 position;
+        float yaw;
+        float pitch;
+    };
+
+    void addKey(float time, const glm::vec3& position, float yaw, float pitch)
+    {
+        Key key = { time, position, yaw, pitch };
+        keys.push_back(key);
+    }
+
+    float duration() const
+    {
+        return keys.empty() ? 0.0f : keys.back().time;
+    }
+
+    // place the camera at time t along the path (clamped to the ends)
+    void apply(Camera& camera, float t) const
+    {
+        if (keys.empty())
+            return;
+        size_t next = 0;
+        while (next < keys.size() && keys[next].time <= t)
+            ++next;
+        const Key& a = keys[next == 0 ? 0 : next - 1];
+        const Key& b = keys[next < keys.size() ? next : keys.size() - 1];
+
+        float s = b.time > a.time ? glm::clamp((t - a.time) / (b.time - a.time), 0.0f, 1.0f) : 0.0f;
+        s = s * s * (3.0f - 2.0f * s); // ease in and out of every key
+        camera.Position = glm::mix(a.position, b.position, s);
+        camera.Yaw = glm::mix(a.yaw, b.yaw, s);
+        camera.Pitch = glm::mix(a.pitch, b.pitch, s);
+        camera.ProcessMouseMovement(0.0f, 0.0f); // recompute Front/Right/Up
+    }
+
+    // the default benchmark: approach from outside, walk between the tables,
+    // look up at the fan and pendant lights, then turn back to the entrance
+    static CameraPath restaurantTour()
+    {
+        CameraPath path;
+        path.addKey(0.0f, glm::vec3(0.0f, 3.0f, 10.0f), -90.0f, 0.0f);
+        path.addKey(2.0f, glm::vec3(0.0f, 2.5f, 4.0f), -90.0f, -10.0f);
+        path.addKey(4.0f, glm::vec3(-2.0f, 1.8f, 0.0f), -135.0f, -15.0f);
+        path.addKey(6.0f, glm::vec3(2.0f, 1.8f, -1.0f), -45.0f, -20.0f);
+        path.addKey(8.0f, glm::vec3(0.0f, 2.0f, 1.0f), -90.0f, 45.0f);
+        path.addKey(10.0f, glm::vec3(3.5f, 2.5f, 3.5f), 135.0f, -10.0f);
+        path.addKey(12.0f, glm::vec3(0.0f, 3.0f, 2.0f), 90.0f, 0.0f);
+        path.addKey(14.0f, glm::vec3(0.0f, 3.0f, 10.0f), 270.0f, 0.0f);
+        return path;
+    }
+
+private:
+    std::vector<Key> keys;
+};
+
+#endif
@@ -3,7 +3,6 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
-#include "shader.h"
 
 class DirectionalLight {
 public:
@@ -21,62 +20,75 @@ public:
         specular = spec;
     }
 
-    void setUpLight(Shader& lightingShader)
-    {
-        lightingShader.use();
-        lightingShader.setVec3("directionalLight.ambient", ambient * ambientOn * isOn);
-        lightingShader.setVec3("directionalLight.diffuse", diffuse * diffuseOn * isOn);
-        lightingShader.setVec3("directionalLight.specular", specular * specularOn * isOn);
-        lightingShader.setVec3("directionalLight.direction", direction);
-    }
+    // light colors with the on/off and per-component toggles applied
+    glm::vec3 effectiveAmbient() const { return ambient * ambientOn * isOn; }
+    glm::vec3 effectiveDiffuse() const { return diffuse * diffuseOn * isOn; }
+    glm::vec3 effectiveSpecular() const { return specular * specularOn * isOn; }
+
+    // set whenever the light changes so LightBuffer knows to re-upload it.
+    // Call markDirty() after editing the public members directly.
+    bool isDirty() const { return dirty; }
+    void markDirty() { dirty = true; }
+    void clearDirty() { dirty = false; }
 
     void turnOff()
     {
         isOn = 0.0;
+        dirty = true;
     }
     void turnOn()
     {
         isOn = 1.0;
+        dirty = true;
     }
     void turnAmbientOn()
     {
         ambientOn = 1.0;
+        dirty = true;
     }
     void turnAmbientOff()
     {
         ambientOn = 0.0;
+        dirty = true;
     }
     void turnDiffuseOn()
     {
         diffuseOn = 1.0;
+        dirty = true;
     }
     void turnDiffuseOff()
     {
         diffuseOn = 0.0;
+        dirty = true;
     }
     void turnSpecularOn()
     {
         specularOn = 1.0;
+        dirty = true;
     }
     void turnSpecularOff()
     {
         specularOn = 0.0;
+        dirty = true;
     }
 
     // Add these new methods for dynamic updates
     void setAmbient(const glm::vec3& amb)
     {
         ambient = amb;
+        dirty = true;
     }
 
     void setDiffuse(const glm::vec3& diff)
     {
         diffuse = diff;
+        dirty = true;
     }
 
     void setSpecular(const glm::vec3& spec)
     {
         specular = spec;
+        dirty = true;
     }
 
 private:
@@ -84,6 +96,8 @@ private:
     float diffuseOn = 1.0;
     float specularOn = 1.0;
     float isOn = 0.0;
+
+    bool dirty = true;
 };
 
 #endif /* directionalLight_h */
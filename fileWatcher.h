@@ -0,0 +1,131 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Reports files that were written since the last check, without blocking.
+// On Linux it listens to inotify events on the files' directories, which
+// also catches editors that save by writing a new file and renaming it over
+// the old one. Elsewhere, or if inotify is unavailable, it polls the
+// modification times a few times a second.
+class FileWatcher
+{
+public:
+    FileWatcher()
+    {
+#ifdef __linux__
+        inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    }
+
+    ~FileWatcher()
+    {
+#ifdef __linux__
+        if (inotify >= 0)
+            close(inotify);
+#endif
+    }
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    void watch(const std::string& path)
+    {
+        WatchedFile file;
+        file.path = path;
+        size_t slash = path.find_last_of("/\\");
+        file.directory = slash == std::string::npos ? "." : path.substr(0, slash);
+        file.name = slash == std::string::npos ? path : path.substr(slash + 1);
+        file.modified = modificationTime(path);
+#ifdef __linux__
+        if (inotify >= 0)
+            file.watch = inotify_add_watch(inotify, file.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+#endif
+        files.push_back(file);
+    }
+
+    // watched files changed since the last call, each listed once
+    std::vector<std::string> changedFiles()
+    {
+        std::vector<std::string> changed;
+#ifdef __linux__
+        if (inotify >= 0)
+        {
+            alignas(inotify_event) char buffer[4096];
+            ssize_t bytes;
+            while ((bytes = read(inotify, buffer, sizeof(buffer))) > 0)
+            {
+                for (char* p = buffer; p < buffer + bytes; p += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(p)->len)
+                {
+                    const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+                    if (event->len == 0)
+                        continue;
+                    for (const WatchedFile& file : files)
+                        if (file.watch == event->wd && file.name == event->name)
+                            addOnce(changed, file.path);
+                }
+            }
+            return changed;
+        }
+#endif
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now - lastPoll < std::chrono::milliseconds(250))
+            return changed;
+        lastPoll = now;
+        for (WatchedFile& file : files)
+        {
+            long long modified = modificationTime(file.path);
+            if (modified != file.modified)
+            {
+                file.modified = modified;
+                addOnce(changed, file.path);
+            }
+        }
+        return changed;
+    }
+
+private:
+    struct WatchedFile
+    {
+        std::string path, directory, name;
+        long long modified = 0;
+        int watch = -1;
+    };
+
+    std::vector<WatchedFile> files;
+    std::chrono::steady_clock::time_point lastPoll;
+#ifdef __linux__
+    int inotify = -1;
+#endif
+
+    // seconds since the epoch, or 0 if the file doesn't exist (e.g. mid-save)
+    static long long modificationTime(const std::string& path)
+    {
+#ifdef _WIN32
+        struct _stat info;
+        return _stat(path.c_str(), &info) == 0 ? static_cast<long long>(info.st_mtime) : 0;
+#else
+        struct stat info;
+        return stat(path.c_str(), &info) == 0 ? static_cast<long long>(info.st_mtime) : 0;
+#endif
+    }
+
+    static void addOnce(std::vector<std::string>& paths, const std::string& path)
+    {
+        for (const std::string& p : paths)
+            if (p == path)
+                return;
+        paths.push_back(path);
+    }
+};
+
+#endif
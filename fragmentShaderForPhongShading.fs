@@ -1,5 +1,27 @@
 #version 330 core
 
+// Feature switches, injected per variant by ShaderVariants (shaderVariants.h).
+// A switch is only turned off when that light or term contributes nothing,
+// so every variant renders the same image; it just skips the work.
+#ifndef DIRECTIONAL_LIGHT
+#define DIRECTIONAL_LIGHT 1
+#endif
+#ifndef POINT_LIGHTS
+#define POINT_LIGHTS 1
+#endif
+#ifndef AMBIENT
+#define AMBIENT 1
+#endif
+#ifndef DIFFUSE
+#define DIFFUSE 1
+#endif
+#ifndef SPECULAR
+#define SPECULAR 1
+#endif
+#ifndef SHADOWS
+#define SHADOWS 1
+#endif
+
 struct Material {
     vec3 ambient;
     vec3 diffuse;
@@ -18,73 +40,198 @@ struct PointLight {
     float k_q; // Quadratic attenuation
 };
 
+// std140 layout, mirrored by the structs in lightBuffer.h
 struct DirectionalLight {
-    vec3 direction;
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
+    vec4 direction;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+};
+
+layout (std140) uniform Lights {
+    DirectionalLight directionalLight;
 };
 
 in vec3 FragPos;
 in vec3 Normal;
+in float ViewDepth;
+in vec3 BakedLight; // ambient + diffuse of every light, precomputed per vertex (lightBaker.h)
+flat in vec4 MaterialAmbientShininess; // fetched from the material table by the vertex shader
+flat in vec3 MaterialDiffuse;
+flat in vec3 MaterialSpecular;
 
 out vec4 FragColor;
 
 uniform vec3 viewPos;
-uniform Material material;
-uniform PointLight pointLights[3]; // Adjust for three lights
-uniform DirectionalLight directionalLight;
+uniform bool bakedLighting; // set while drawing geometry that carries BakedLight
+
+// Point lights, four texels each (see PointLightTexels in lightBuffer.h)
+uniform samplerBuffer pointLightData;
+// Clustered lighting (see lightClusters.h): per cluster an (offset, count)
+// range into clusterLightIndices
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterLightIndices;
+uniform ivec3 clusterDims;
+uniform vec4 clusterScale; // xy = tiles per pixel, z/w = depth slice scale and bias
+
+#if SHADOWS
+// Shadow maps (see shadowMaps.h): a distance cube map for each of the first
+// shadowedPointLights point lights, and a depth map for the directional light.
+// Baked surfaces carry only the ambient light of these lights.
+uniform samplerCubeShadow pointShadowMaps[4];
+uniform int shadowedPointLights;
+uniform vec4 pointShadowFar;     // distance stored as depth 1, per cube map
+uniform float pointShadowBias;   // per unit of distance from the light
+uniform sampler2DShadow directionalShadowMap;
+uniform mat4 directionalShadowMatrix; // world to shadow map coordinates, bias included
+uniform float directionalShadowTexel; // size of a directional shadow map texel in world units
+
+// Lookups start slightly off the surface, along the normal of the face
+// itself (the interpolated Normal needn't be it), against shadow acne
+vec3 faceNormal;
+#endif
 
 // Function prototypes
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 viewDir);
-vec3 CalcDirectionalLight(DirectionalLight light, vec3 normal, vec3 viewDir);
+PointLight FetchPointLight(int index);
+float PointShadow(int index, vec3 lightPosition);
+float DirectionalShadow();
+vec3 CalcPointLight(PointLight light, Material mat, vec3 normal, vec3 viewDir, float shadow, bool shadowed);
+vec3 CalcDirectionalLight(DirectionalLight light, Material mat, vec3 normal, vec3 viewDir, float shadow, bool shadowed);
 
 void main()
 {
     vec3 norm = normalize(Normal);
     vec3 viewDir = normalize(viewPos - FragPos);
-
-    // Cumulative light contributions
-    vec3 result = vec3(0.0);
-    for (int i = 0; i < 3; i++) { // three point lights
-        result += CalcPointLight(pointLights[i], norm, viewDir);
+    Material mat = Material(MaterialAmbientShininess.rgb, MaterialDiffuse, MaterialSpecular, MaterialAmbientShininess.a);
+#if SHADOWS
+    faceNormal = normalize(cross(dFdx(FragPos), dFdy(FragPos)));
+#endif
+
+    // Cumulative light contributions; baked surfaces only add specular, and
+    // the diffuse light of shadow casting lights, on top
+    vec3 result = bakedLighting ? BakedLight : vec3(0.0);
+#if POINT_LIGHTS
+    if (SPECULAR == 1 || SHADOWS == 1 || !bakedLighting) {
+        // only the point lights whose range reaches this fragment's cluster
+        ivec3 cell = ivec3(gl_FragCoord.xy * clusterScale.xy, log(ViewDepth) * clusterScale.z + clusterScale.w);
+        cell = clamp(cell, ivec3(0), clusterDims - 1);
+        uvec2 range = texelFetch(clusterGrid, cell.x + clusterDims.x * (cell.y + clusterDims.y * cell.z)).rg;
+        for (uint i = 0u; i < range.y; i++) {
+            int light = int(texelFetch(clusterLightIndices, int(range.x + i)).r);
+            PointLight pointLight = FetchPointLight(light);
+#if SHADOWS
+            bool shadowed = light < shadowedPointLights;
+#else
+            bool shadowed = false;
+#endif
+            float shadow = shadowed ? PointShadow(light, pointLight.position) : 1.0;
+            result += CalcPointLight(pointLight, mat, norm, viewDir, shadow, shadowed);
+        }
     }
-    result += CalcDirectionalLight(directionalLight, norm, viewDir);
+#endif
+#if DIRECTIONAL_LIGHT
+    if (SPECULAR == 1 || SHADOWS == 1 || !bakedLighting)
+        result += CalcDirectionalLight(directionalLight, mat, norm, viewDir, DirectionalShadow(), SHADOWS == 1);
+#endif
 
     FragColor = vec4(result, 1.0);
 }
 
-// Point light calculation
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 viewDir)
+PointLight FetchPointLight(int index)
 {
-    vec3 lightDir = normalize(light.position - FragPos);
-    float diff = max(dot(normal, lightDir), 0.0);
+    vec4 positionConstant = texelFetch(pointLightData, 4 * index);
+    vec4 ambientLinear = texelFetch(pointLightData, 4 * index + 1);
+    vec4 diffuseQuadratic = texelFetch(pointLightData, 4 * index + 2);
+    vec4 specularRange = texelFetch(pointLightData, 4 * index + 3);
+    return PointLight(positionConstant.xyz, ambientLinear.rgb, diffuseQuadratic.rgb, specularRange.rgb,
+                      positionConstant.w, ambientLinear.w, diffuseQuadratic.w);
+}
 
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+// Fraction of the point light with the given index that reaches the
+// fragment, 0 to 1 with the 2x2 filtered comparison
+float PointShadow(int index, vec3 lightPosition)
+{
+#if SHADOWS
+    vec3 toLight = lightPosition - FragPos;
+    float texel = length(toLight) * pointShadowBias;
+    vec3 fromLight = FragPos + faceNormal * (dot(faceNormal, toLight) < 0.0 ? -texel : texel) - lightPosition;
+    float distance = length(fromLight);
+    vec4 coord = vec4(fromLight, distance * (1.0 - pointShadowBias) / pointShadowFar[index]);
+    // sampler arrays only take constant indices in GLSL 3.30
+    if (index == 0)
+        return texture(pointShadowMaps[0], coord);
+    if (index == 1)
+        return texture(pointShadowMaps[1], coord);
+    if (index == 2)
+        return texture(pointShadowMaps[2], coord);
+    return texture(pointShadowMaps[3], coord);
+#else
+    return 1.0;
+#endif
+}
+
+float DirectionalShadow()
+{
+#if SHADOWS
+    vec3 toLight = -directionalLight.direction.xyz;
+    vec3 offset = faceNormal * (dot(faceNormal, toLight) < 0.0 ? -directionalShadowTexel : directionalShadowTexel);
+    vec4 coord = directionalShadowMatrix * vec4(FragPos + offset, 1.0);
+    return texture(directionalShadowMap, coord.xyz);
+#else
+    return 1.0;
+#endif
+}
+
+// Point light calculation; shadow scales the diffuse and specular terms.
+// The diffuse term of a light that isn't shadowed is baked, where baking is on.
+vec3 CalcPointLight(PointLight light, Material mat, vec3 normal, vec3 viewDir, float shadow, bool shadowed)
+{
+    vec3 lightDir = normalize(light.position - FragPos);
 
     float distance = length(light.position - FragPos);
     float attenuation = 1.0 / (light.k_c + light.k_l * distance + light.k_q * (distance * distance));
 
-    vec3 ambient = light.ambient * material.ambient;   //Ambient Scaling intensity 
-    vec3 diffuse = light.diffuse * diff * material.diffuse; 
-    vec3 specular = light.specular * spec * material.specular; 
+    vec3 result = vec3(0.0);
+#if AMBIENT
+    if (!bakedLighting)
+        result += light.ambient * mat.ambient;   //Ambient Scaling intensity 
+#endif
+#if DIFFUSE
+    if (!bakedLighting || shadowed) {
+        float diff = max(dot(normal, lightDir), 0.0);
+        result += shadow * light.diffuse * diff * mat.diffuse; 
+    }
+#endif
+#if SPECULAR
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), mat.shininess);
+    result += shadow * light.specular * spec * mat.specular; 
+#endif
 
-    return attenuation * (ambient + diffuse + specular); 
+    return attenuation * result; 
 }
 
-// Directional light calculation
-vec3 CalcDirectionalLight(DirectionalLight light, vec3 normal, vec3 viewDir)
+// Directional light calculation, like CalcPointLight
+vec3 CalcDirectionalLight(DirectionalLight light, Material mat, vec3 normal, vec3 viewDir, float shadow, bool shadowed)
 {
-    vec3 lightDir = normalize(-light.direction);
-    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 lightDir = normalize(-light.direction.xyz);
 
+    vec3 result = vec3(0.0);
+#if AMBIENT
+    if (!bakedLighting)
+        result += light.ambient.rgb * mat.ambient;
+#endif
+#if DIFFUSE
+    if (!bakedLighting || shadowed) {
+        float diff = max(dot(normal, lightDir), 0.0);
+        result += shadow * light.diffuse.rgb * diff * mat.diffuse;
+    }
+#endif
+#if SPECULAR
     vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-
-    vec3 ambient = light.ambient * material.ambient;
-    vec3 diffuse = light.diffuse * diff * material.diffuse;
-    vec3 specular = light.specular * spec * material.specular;
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), mat.shininess);
+    result += shadow * light.specular.rgb * spec * mat.specular;
+#endif
 
-    return ambient + diffuse + specular;
+    return result;
 }
@@ -0,0 +1,94 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Collects per-frame times and summarizes them as min/mean/percentiles,
+// along with how many scene nodes each frame drew and culled
+class FrameStats
+{
+public:
+    struct Summary
+    {
+        int frames = 0;
+        double min = 0.0, mean = 0.0, p50 = 0.0, p95 = 0.0, p99 = 0.0, max = 0.0;
+    };
+
+    void add(double milliseconds, int visible, int culled)
+    {
+        samples.push_back(milliseconds);
+        visibleCounts.push_back(visible);
+        culledCounts.push_back(culled);
+    }
+
+    Summary summarize() const
+    {
+        Summary summary;
+        if (samples.empty())
+            return summary;
+        std::vector<double> sorted(samples);
+        std::sort(sorted.begin(), sorted.end());
+        double total = 0.0;
+        for (double sample : sorted)
+            total += sample;
+        summary.frames = static_cast<int>(sorted.size());
+        summary.min = sorted.front();
+        summary.max = sorted.back();
+        summary.mean = total / sorted.size();
+        summary.p50 = percentile(sorted, 50.0);
+        summary.p95 = percentile(sorted, 95.0);
+        summary.p99 = percentile(sorted, 99.0);
+        return summary;
+    }
+
+    // write the summary and the raw samples; extra is inserted verbatim as
+    // additional top-level members (e.g. "\"renderer\": \"llvmpipe\"")
+    bool writeJson(const std::string& path, const std::vector<std::string>& extra = std::vector<std::string>()) const
+    {
+        std::ofstream out(path.c_str());
+        if (!out)
+            return false;
+        Summary summary = summarize();
+        out << "{\n";
+        for (const std::string& member : extra)
+            out << "  " << member << ",\n";
+        out << "  \"frames\": " << summary.frames << ",\n";
+        out << "  \"frame_ms\": { \"min\": " << summary.min << ", \"mean\": " << summary.mean
+            << ", \"p50\": " << summary.p50 << ", \"p95\": " << summary.p95 << ", \"p99\": " << summary.p99
+            << ", \"max\": " << summary.max << " },\n";
+        writeArray(out, "samples_ms", samples);
+        out << ",\n";
+        writeArray(out, "visible", visibleCounts);
+        out << ",\n";
+        writeArray(out, "culled", culledCounts);
+        out << "\n}\n";
+        return true;
+    }
+
+private:
+    std::vector<double> samples;
+    std::vector<int> visibleCounts, culledCounts; // per sample
+
+    template <typename T>
+    static void writeArray(std::ofstream& out, const char* name, const std::vector<T>& values)
+    {
+        out << "  \"" << name << "\": [";
+        for (size_t i = 0; i < values.size(); ++i)
+            out << (i ? ", " : "") << values[i];
+        out << "]";
+    }
+
+    // nearest-rank percentile of sorted samples
+    static double percentile(const std::vector<double>& sorted, double p)
+    {
+        size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+        rank = std::max<size_t>(1, std::min(rank, sorted.size()));
+        return sorted[rank - 1];
+    }
+};
+
+#endif
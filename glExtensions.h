@@ -0,0 +1,108 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+#include <cstring>
+#include <string>
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+// Entry points newer than the GL 3.3 core profile glad is generated for,
+// looked up at runtime so the app still starts on drivers without them.
+// load() must run right after gladLoadGLLoader, with the same loader.
+class GLExtensions
+{
+public:
+    typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+    typedef void (APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+    typedef void (APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+    typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+    typedef void (APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+    // GL 4.1 / ARB_get_program_binary, with at least one binary format
+    bool programBinary = false;
+    GetProgramBinaryProc getProgramBinary = nullptr;
+    ProgramBinaryProc programBinaryFrom = nullptr; // glProgramBinary
+    ProgramParameteriProc programParameteri = nullptr;
+
+    // KHR/ARB_parallel_shader_compile: compiles and links run on driver
+    // threads and are polled with GL_COMPLETION_STATUS_KHR instead of blocking
+    bool parallelShaderCompile = false;
+    MaxShaderCompilerThreadsProc maxShaderCompilerThreads = nullptr;
+
+    // GL 4.4 / ARB_buffer_storage: immutable buffers that can stay mapped
+    // (GL_MAP_PERSISTENT_BIT) while the GPU reads them
+    bool bufferStorage = false;
+    BufferStorageProc bufferStorageFrom = nullptr; // glBufferStorage
+
+    static GLExtensions& get()
+    {
+        static GLExtensions extensions;
+        return extensions;
+    }
+
+    static void load(GLADloadproc loader)
+    {
+        GLExtensions& gl = get();
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        int version = major * 10 + minor;
+
+        if (version >= 41 || hasExtension("GL_ARB_get_program_binary"))
+        {
+            gl.getProgramBinary = (GetProgramBinaryProc)loader("glGetProgramBinary");
+            gl.programBinaryFrom = (ProgramBinaryProc)loader("glProgramBinary");
+            gl.programParameteri = (ProgramParameteriProc)loader("glProgramParameteri");
+            GLint formats = 0;
+            if (gl.getProgramBinary && gl.programBinaryFrom && gl.programParameteri)
+                glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            gl.programBinary = formats > 0;
+        }
+
+        if (hasExtension("GL_KHR_parallel_shader_compile"))
+            gl.maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)loader("glMaxShaderCompilerThreadsKHR");
+        else if (hasExtension("GL_ARB_parallel_shader_compile"))
+            gl.maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)loader("glMaxShaderCompilerThreadsARB");
+        gl.parallelShaderCompile = gl.maxShaderCompilerThreads != nullptr;
+
+        if (version >= 44 || hasExtension("GL_ARB_buffer_storage"))
+            gl.bufferStorageFrom = (BufferStorageProc)loader("glBufferStorage");
+        gl.bufferStorage = gl.bufferStorageFrom != nullptr;
+    }
+
+    static bool hasExtension(const char* name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; ++i)
+        {
+            const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+            if (extension && std::strcmp(extension, name) == 0)
+                return true;
+        }
+        return false;
+    }
+
+private:
+    GLExtensions() {}
+};
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef INSTANCED_RENDERER_H
+#define INSTANCED_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+#include "normalMatrix.h"
+#include "meshBuffer.h"
+#include "streamBuffer.h"
+
+// Per-instance attributes, laid out to match locations 2-9 in vertexShaderForPhongShading.vs
+struct InstanceData
+{
+    glm::mat4 model;
+    GLuint material;      // index into the MaterialLibrary
+    glm::mat3 normalMatrix;
+};
+
+// Gathers every object that shares one mesh into an instance buffer and draws
+// them all with a single glDrawElementsInstanced call. The mesh may be a range
+// of a larger index buffer, starting at firstIndex. A batch can be rebuilt
+// every frame (begin/add/flush) or recorded once, uploaded and then only drawn.
+// Streamed uploads go through a StreamBuffer, and the instance attributes are
+// re-pointed at whichever partition the latest upload landed in.
+class InstancedRenderer
+{
+public:
+    unsigned int VAO, instanceVBO;
+
+    explicit InstancedRenderer(const MeshBuffer& mesh)
+        : InstancedRenderer(mesh, mesh.indexCount, 0)
+    {
+    }
+
+    InstancedRenderer(const MeshBuffer& mesh, GLsizei indexCount, GLsizei firstIndex)
+        : indexType(mesh.indexType), indexCount(indexCount), indexOffset(mesh.indexOffset(firstIndex)), stream(GL_ARRAY_BUFFER)
+    {
+        setupMesh(mesh);
+    }
+
+    ~InstancedRenderer()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &instanceVBO);
+    }
+
+    InstancedRenderer(const InstancedRenderer&) = delete;
+    InstancedRenderer& operator=(const InstancedRenderer&) = delete;
+
+    void begin()
+    {
+        instances.clear();
+    }
+
+    void add(const glm::mat4& model, GLuint material)
+    {
+        add(makeInstance(model, material));
+    }
+
+    void add(const InstanceData& instance)
+    {
+        instances.push_back(instance);
+    }
+
+    // begin() with room for count instances, to be written in place, e.g. by several threads
+    InstanceData* beginFill(size_t count)
+    {
+        instances.resize(count);
+        return instances.data();
+    }
+
+    static InstanceData makeInstance(const glm::mat4& model, GLuint material)
+    {
+        InstanceData instance;
+        instance.model = model;
+        instance.material = material;
+        instance.normalMatrix = computeNormalMatrix(model);
+        return instance;
+    }
+
+    // copy the gathered instances to the GPU. GL_STREAM_DRAW for per-frame
+    // batches, GL_STATIC_DRAW for batches that are recorded once.
+    void upload(GLenum usage = GL_STREAM_DRAW)
+    {
+        size_t bytes = instances.size() * sizeof(InstanceData);
+        GLuint buffer = instanceVBO;
+        size_t offset = 0;
+        if (usage == GL_STATIC_DRAW)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            glBufferData(GL_ARRAY_BUFFER, bytes, instances.data(), usage);
+        }
+        else if (bytes > 0)
+        {
+            offset = stream.upload(instances.data(), bytes);
+            buffer = stream.buffer();
+        }
+        if (buffer != boundBuffer || offset != boundOffset)
+        {
+            glBindVertexArray(VAO);
+            bindInstanceAttributes(buffer, true, offset);
+            glBindVertexArray(0);
+            boundBuffer = buffer;
+            boundOffset = offset;
+        }
+        uploadedCount = instances.size();
+    }
+
+    // draw whatever was last uploaded; the shader must be bound
+    void draw()
+    {
+        if (uploadedCount == 0)
+            return;
+        glBindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, indexType, indexOffset, static_cast<GLsizei>(uploadedCount));
+        glBindVertexArray(0);
+        stream.fence();
+    }
+
+    void flush()
+    {
+        upload();
+        draw();
+    }
+
+    size_t instanceCount() const
+    {
+        return instances.size();
+    }
+
+    // whether streamed uploads use a persistently mapped buffer rather than orphaning
+    bool streamsPersistently() const
+    {
+        return stream.isPersistent();
+    }
+
+    // point locations 2-9 of the bound VAO at an InstanceData buffer (one
+    // attribute per matrix column), starting offset bytes in. Without the
+    // material, location 6 is left to the mesh, e.g. a per-vertex material id.
+    static void bindInstanceAttributes(GLuint buffer, bool material, size_t offset = 0)
+    {
+        const char* base = reinterpret_cast<const char*>(offset);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        for (int column = 0; column < 4; ++column)
+        {
+            GLuint location = 2 + column;
+            glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), base + offsetof(InstanceData, model) + column * sizeof(glm::vec4));
+            glEnableVertexAttribArray(location);
+            glVertexAttribDivisor(location, 1);
+        }
+        if (material)
+        {
+            glVertexAttribIPointer(MeshBuffer::MATERIAL_LOCATION, 1, GL_UNSIGNED_INT, sizeof(InstanceData), base + offsetof(InstanceData, material));
+            glEnableVertexAttribArray(MeshBuffer::MATERIAL_LOCATION);
+            glVertexAttribDivisor(MeshBuffer::MATERIAL_LOCATION, 1);
+        }
+        for (int column = 0; column < 3; ++column)
+        {
+            GLuint location = 7 + column;
+            glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), base + offsetof(InstanceData, normalMatrix) + column * sizeof(glm::vec3));
+            glEnableVertexAttribArray(location);
+            glVertexAttribDivisor(location, 1);
+        }
+    }
+
+private:
+    GLenum indexType;
+    GLsizei indexCount;
+    const void* indexOffset;
+    size_t uploadedCount = 0;
+    std::vector<InstanceData> instances;
+    StreamBuffer stream;
+    GLuint boundBuffer = 0; // where the VAO's instance attributes point
+    size_t boundOffset = 0;
+
+    void setupMesh(const MeshBuffer& mesh)
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &instanceVBO);
+
+        glBindVertexArray(VAO);
+
+        // shared mesh: position + normal, in whichever layout it was uploaded with
+        mesh.bindAttributes();
+
+        // per-instance: model matrix, material index, normal matrix
+        bindInstanceAttributes(instanceVBO, true);
+        boundBuffer = instanceVBO;
+
+        glBindVertexArray(0);
+    }
+};
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small work-stealing scheduler for data-parallel loops. parallelFor()
+// hands a range to the calling thread, which keeps splitting it in half:
+// one half goes on the thread's own queue, the other is worked on. Idle
+// threads steal the oldest (largest) pieces from the front of other queues,
+// while each owner pops its newest (smallest, cache-warm) piece from the
+// back, so the load evens out without a central queue. Thread 0 is the
+// caller, which works too while it waits; body(begin, end, thread) gets
+// the thread index, e.g. to write into per-thread buffers.
+// parallelFor() is meant to be called from one thread and not from a body.
+class JobSystem
+{
+public:
+    // threads: total including the caller; 0 for one per hardware thread
+    explicit JobSystem(unsigned int threads = 0)
+    {
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned int i = 0; i < threads; ++i)
+            queues.push_back(std::unique_ptr<Queue>(new Queue()));
+        for (unsigned int i = 1; i < threads; ++i)
+            workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    unsigned int threadCount() const
+    {
+        return static_cast<unsigned int>(queues.size());
+    }
+
+    // run body over [0, count) in pieces of at most grain items; returns when all are done
+    template <typename Body>
+    void parallelFor(int count, int grain, const Body& body)
+    {
+        if (count <= 0)
+            return;
+        grain = std::max(1, grain);
+        if (workers.empty() || count <= grain)
+        {
+            body(0, count, 0u);
+            return;
+        }
+
+        Batch batch;
+        batch.body = std::cref(body);
+        batch.grain = grain;
+        batch.remaining = count;
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            ++activeBatches;
+        }
+        wake.notify_all();
+
+        run(Job{ &batch, 0, count }, 0);
+        while (batch.remaining.load(std::memory_order_acquire) > 0)
+        {
+            Job job;
+            if (findJob(0, job))
+                run(job, 0);
+            else
+                std::this_thread::yield();
+        }
+
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        --activeBatches;
+    }
+
+private:
+    struct Batch
+    {
+        std::function<void(int, int, unsigned int)> body;
+        int grain;
+        std::atomic<int> remaining; // items not finished yet
+    };
+
+    struct Job
+    {
+        Batch* batch;
+        int begin, end;
+    };
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue> > queues;
+    std::vector<std::thread> workers;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    int activeBatches = 0;
+    bool stopping = false;
+
+    void run(Job job, unsigned int thread)
+    {
+        while (job.end - job.begin > job.batch->grain)
+        {
+            int middle = job.begin + (job.end - job.begin) / 2;
+            {
+                Queue& queue = *queues[thread];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                queue.jobs.push_back(Job{ job.batch, middle, job.end });
+            }
+            job.end = middle;
+        }
+        job.batch->body(job.begin, job.end, thread);
+        job.batch->remaining.fetch_sub(job.end - job.begin, std::memory_order_acq_rel);
+    }
+
+    // newest job of our own queue, or else the oldest of someone else's
+    bool findJob(unsigned int thread, Job& job)
+    {
+        {
+            Queue& own = *queues[thread];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.jobs.empty())
+            {
+                job = own.jobs.back();
+                own.jobs.pop_back();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues.size(); ++i)
+        {
+            Queue& victim = *queues[(thread + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty())
+            {
+                job = victim.jobs.front();
+                victim.jobs.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(unsigned int thread)
+    {
+        for (;;)
+        {
+            Job job;
+            if (findJob(thread, job))
+            {
+                run(job, thread);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            if (stopping)
+                return;
+            if (activeBatches == 0)
+            {
+                wake.wait(lock, [this] { return stopping || activeBatches > 0; });
+                continue;
+            }
+            lock.unlock();
+            std::this_thread::yield(); // a loop is running; its pieces may not be queued yet
+        }
+    }
+};
+
+#endif
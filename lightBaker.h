@@ -0,0 +1,111 @@
+#ifndef LIGHT_BAKER_H
+#define LIGHT_BAKER_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "directionalLight.h"
+#include "jobSystem.h"
+#include "materialLibrary.h"
+#include "pointLight.h"
+
+// Precomputes what the fixed lights contribute to static geometry that
+// doesn't depend on the viewer: the ambient and diffuse terms of
+// fragmentShaderForPhongShading.fs, attenuation included, per vertex. Only
+// the specular term is left for the fragment shader. Point lights are cut
+// off at PointLight::range() like the light clusters do. Vertices are baked
+// in parallel on the JobSystem. A bake goes stale whenever a light is
+// switched or changed; compare state() before and after to find out.
+// Lights that cast shadows only have their ambient term baked, since their
+// diffuse light depends on what moves in between.
+class LightBaker
+{
+public:
+    struct Vertex
+    {
+        glm::vec3 position;
+        glm::vec3 normal; // as the rasterizer interpolates it, not necessarily unit length
+        unsigned int material;
+    };
+
+    // the lights that cast shadows; Shadowed() is none
+    struct Shadowed
+    {
+        bool directional;
+        size_t pointLights; // the first this many
+    };
+
+    // a hash of everything a bake depends on; equal states bake equal colors
+    static uint64_t state(const DirectionalLight& directional, const std::vector<PointLight*>& pointLights, const Shadowed& shadowed = Shadowed())
+    {
+        uint64_t hash = 14695981039346656037ull; // FNV-1a
+        hashValue(hash, shadowed.directional);
+        hashValue(hash, shadowed.pointLights);
+        hashValue(hash, directional.direction);
+        hashValue(hash, directional.effectiveAmbient());
+        hashValue(hash, directional.effectiveDiffuse());
+        for (const PointLight* light : pointLights)
+        {
+            hashValue(hash, light->position);
+            hashValue(hash, light->effectiveAmbient());
+            hashValue(hash, light->effectiveDiffuse());
+            hashValue(hash, glm::vec4(light->k_c, light->k_l, light->k_q, light->range()));
+        }
+        return hash;
+    }
+
+    // colors[i] = ambient + diffuse light reaching vertices[i], times its material
+    static void bake(const std::vector<Vertex>& vertices, const MaterialLibrary& materials, const DirectionalLight& directional,
+                     const std::vector<PointLight*>& pointLights, JobSystem& jobs, std::vector<glm::vec3>& colors, const Shadowed& shadowed = Shadowed())
+    {
+        colors.resize(vertices.size());
+        glm::vec3 directionalDir = glm::normalize(-directional.direction);
+        glm::vec3 directionalDiffuse = shadowed.directional ? glm::vec3(0.0f) : directional.effectiveDiffuse();
+        jobs.parallelFor(static_cast<int>(vertices.size()), 1024, [&](int begin, int end, unsigned int) {
+            for (int i = begin; i < end; ++i)
+            {
+                const Vertex& vertex = vertices[i];
+                const Material& material = materials[vertex.material];
+                float length = glm::length(vertex.normal);
+                bool hasNormal = length > 1.0e-6f;
+                glm::vec3 normal = hasNormal ? vertex.normal / length : glm::vec3(0.0f);
+
+                glm::vec3 color = directional.effectiveAmbient() * material.ambient;
+                if (hasNormal)
+                    color += directionalDiffuse * glm::max(glm::dot(normal, directionalDir), 0.0f) * material.diffuse;
+
+                for (size_t l = 0; l < pointLights.size(); ++l)
+                {
+                    const PointLight* light = pointLights[l];
+                    glm::vec3 toLight = light->position - vertex.position;
+                    float distance = glm::length(toLight);
+                    if (distance > light->range())
+                        continue;
+                    float attenuation = 1.0f / (light->k_c + light->k_l * distance + light->k_q * (distance * distance));
+                    glm::vec3 lit = light->effectiveAmbient() * material.ambient;
+                    if (hasNormal && distance > 0.0f && l >= shadowed.pointLights)
+                        lit += light->effectiveDiffuse() * glm::max(glm::dot(normal, toLight / distance), 0.0f) * material.diffuse;
+                    color += attenuation * lit;
+                }
+                colors[i] = color;
+            }
+        });
+    }
+
+private:
+    template <typename T>
+    static void hashValue(uint64_t& hash, const T& value)
+    {
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        for (unsigned char byte : bytes)
+        {
+            hash ^= byte;
+            hash *= 1099511628211ull;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef LIGHT_BUFFER_H
+#define LIGHT_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "pointLight.h"
+#include "directionalLight.h"
+
+// std140 mirror of the "Lights" uniform block in fragmentShaderForPhongShading.fs.
+// Every member is a vec4 so the C++ and GLSL layouts match without padding rules.
+struct DirectionalLightStd140
+{
+    glm::vec4 direction;
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+};
+
+// One point light as four RGBA32F texels of the pointLightData buffer texture
+struct PointLightTexels
+{
+    glm::vec4 positionConstant;  // xyz = position, w = k_c
+    glm::vec4 ambientLinear;     // rgb = ambient, w = k_l
+    glm::vec4 diffuseQuadratic;  // rgb = diffuse, w = k_q
+    glm::vec4 specularRange;     // rgb = specular, w = range
+};
+
+// Owns the GPU copies of every light in the scene: the directional light in a
+// uniform block and any number of point lights in a buffer texture. Lights
+// mark themselves dirty when toggled or edited; update() repacks and
+// re-uploads only on frames where at least one of them changed.
+class LightBuffer
+{
+public:
+    static const GLuint BINDING = 0;          // uniform block binding of "Lights"
+    static const GLuint POINT_LIGHT_UNIT = 0; // texture unit of pointLightData
+
+    struct Block
+    {
+        DirectionalLightStd140 directionalLight;
+    };
+
+    unsigned int UBO, pointLightTBO, pointLightTexture;
+
+    LightBuffer()
+    {
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, UBO);
+
+        glGenBuffers(1, &pointLightTBO);
+        glGenTextures(1, &pointLightTexture);
+        glBindBuffer(GL_TEXTURE_BUFFER, pointLightTBO);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(PointLightTexels), nullptr, GL_DYNAMIC_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, pointLightTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, pointLightTBO);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    ~LightBuffer()
+    {
+        glDeleteBuffers(1, &UBO);
+        glDeleteTextures(1, &pointLightTexture);
+        glDeleteBuffers(1, &pointLightTBO);
+    }
+
+    LightBuffer(const LightBuffer&) = delete;
+    LightBuffer& operator=(const LightBuffer&) = delete;
+
+    void setDirectionalLight(DirectionalLight* light)
+    {
+        directionalLight = light;
+        forceUpload = true;
+    }
+
+    // point lights are indexed in the order they are added
+    void addPointLight(PointLight* light)
+    {
+        pointLights.push_back(light);
+        forceUpload = true;
+    }
+
+    // upload the lights if any of them changed since the last call; returns true if it did
+    bool update()
+    {
+        bool dirty = forceUpload;
+        if (directionalLight && directionalLight->isDirty())
+            dirty = true;
+        for (const PointLight* light : pointLights)
+            if (light->isDirty())
+                dirty = true;
+        if (!dirty)
+            return false;
+
+        Block block = {};
+        if (directionalLight)
+        {
+            pack(*directionalLight, block.directionalLight);
+            directionalLight->clearDirty();
+        }
+        packed.resize(pointLights.size());
+        for (size_t i = 0; i < pointLights.size(); ++i)
+        {
+            pack(*pointLights[i], packed[i]);
+            pointLights[i]->clearDirty();
+        }
+
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &block);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        if (!packed.empty())
+        {
+            glBindBuffer(GL_TEXTURE_BUFFER, pointLightTBO);
+            glBufferData(GL_TEXTURE_BUFFER, packed.size() * sizeof(PointLightTexels), packed.data(), GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        }
+        forceUpload = false;
+        ++uploads;
+        return true;
+    }
+
+    void bindTextures() const
+    {
+        glActiveTexture(GL_TEXTURE0 + POINT_LIGHT_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, pointLightTexture);
+    }
+
+    // the point lights as last uploaded, in index order
+    const std::vector<PointLightTexels>& packedPointLights() const
+    {
+        return packed;
+    }
+
+    // bumps on every upload, so consumers can tell when packedPointLights() changed
+    unsigned int uploadCount() const
+    {
+        return uploads;
+    }
+
+private:
+    DirectionalLight* directionalLight = nullptr;
+    std::vector<PointLight*> pointLights;
+    std::vector<PointLightTexels> packed;
+    bool forceUpload = true;
+    unsigned int uploads = 0;
+
+    static void pack(const DirectionalLight& light, DirectionalLightStd140& out)
+    {
+        out.direction = glm::vec4(light.direction, 0.0f);
+        out.ambient = glm::vec4(light.effectiveAmbient(), 0.0f);
+        out.diffuse = glm::vec4(light.effectiveDiffuse(), 0.0f);
+        out.specular = glm::vec4(light.effectiveSpecular(), 0.0f);
+    }
+
+    static void pack(const PointLight& light, PointLightTexels& out)
+    {
+        out.positionConstant = glm::vec4(light.position, light.k_c);
+        out.ambientLinear = glm::vec4(light.effectiveAmbient(), light.k_l);
+        out.diffuseQuadratic = glm::vec4(light.effectiveDiffuse(), light.k_q);
+        out.specularRange = glm::vec4(light.effectiveSpecular(), light.range());
+    }
+};
+
+#endif
@@ -0,0 +1,283 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "shader.h"
+#include "jobSystem.h"
+#include "lightBuffer.h"
+
+// Clustered forward shading. The view frustum is split into a grid of
+// TILES_X x TILES_Y screen tiles and SLICES exponential depth slices, and
+// every point light is binned into the clusters its range sphere touches.
+// The fragment shader looks up its own cluster and only loops over that
+// cluster's lights, so the per-fragment cost no longer grows with the total
+// light count. Binning runs on the CPU, one depth slice per JobSystem job,
+// and only when the camera, projection or lights changed.
+class LightClusters
+{
+public:
+    static const int TILES_X = 16;
+    static const int TILES_Y = 9;
+    static const int SLICES = 24;
+    static const int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+    static const GLuint GRID_UNIT = 1;  // texture unit of clusterGrid
+    static const GLuint INDEX_UNIT = 2; // texture unit of clusterLightIndices
+
+    unsigned int gridTBO, gridTexture, indexTBO, indexTexture;
+
+    explicit LightClusters(JobSystem& jobs)
+        : jobs(jobs), grid(2 * CLUSTER_COUNT, 0), sliceIndices(SLICES), threadCandidates(jobs.threadCount())
+    {
+        glGenBuffers(1, &gridTBO);
+        glGenTextures(1, &gridTexture);
+        glBindBuffer(GL_TEXTURE_BUFFER, gridTBO);
+        glBufferData(GL_TEXTURE_BUFFER, grid.size() * sizeof(GLuint), grid.data(), GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, gridTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, gridTBO);
+
+        glGenBuffers(1, &indexTBO);
+        glGenTextures(1, &indexTexture);
+        glBindBuffer(GL_TEXTURE_BUFFER, indexTBO);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(GLuint), nullptr, GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, indexTBO);
+
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    ~LightClusters()
+    {
+        glDeleteTextures(1, &gridTexture);
+        glDeleteBuffers(1, &gridTBO);
+        glDeleteTextures(1, &indexTexture);
+        glDeleteBuffers(1, &indexTBO);
+    }
+
+    LightClusters(const LightClusters&) = delete;
+    LightClusters& operator=(const LightClusters&) = delete;
+
+    void resolveUniforms(const Shader& shader)
+    {
+        clusterDimsUniform = shader.uniform<glm::ivec3>("clusterDims");
+        clusterScaleUniform = shader.uniform<glm::vec4>("clusterScale");
+        uniformsDirty = true; // a new program has none of them set yet
+    }
+
+    // re-bin the lights if the camera, projection, viewport or lights changed
+    // since the last call; returns true if the clusters were rebuilt
+    bool update(const LightBuffer& lights, const glm::mat4& view, float fovy, float aspect, float zNear, float zFar, int viewportWidth, int viewportHeight)
+    {
+        glm::vec4 frustum(fovy, aspect, zNear, zFar);
+        bool projectionChanged = frustum != lastFrustum || viewportWidth != lastViewportWidth || viewportHeight != lastViewportHeight;
+        if (!projectionChanged && view == lastView && lights.uploadCount() == lastLightUpload)
+            return false;
+
+        lastView = view;
+        lastFrustum = frustum;
+        lastViewportWidth = viewportWidth;
+        lastViewportHeight = viewportHeight;
+        lastLightUpload = lights.uploadCount();
+
+        tanHalfY = std::tan(fovy * 0.5f);
+        tanHalfX = tanHalfY * aspect;
+        this->zNear = zNear;
+        depthRatio = zFar / zNear;
+        if (projectionChanged)
+        {
+            float logRatio = std::log(depthRatio);
+            clusterScale = glm::vec4(TILES_X / static_cast<float>(viewportWidth), TILES_Y / static_cast<float>(viewportHeight),
+                                     SLICES / logRatio, -SLICES * std::log(zNear) / logRatio);
+            uniformsDirty = true;
+        }
+
+        // light spheres in view space; lights that are off have no range and are skipped
+        spheres.clear();
+        const std::vector<PointLightTexels>& packed = lights.packedPointLights();
+        for (size_t i = 0; i < packed.size(); ++i)
+        {
+            float radius = packed[i].specularRange.w;
+            if (radius <= 0.0f)
+                continue;
+            LightSphere sphere;
+            sphere.center = glm::vec3(view * glm::vec4(glm::vec3(packed[i].positionConstant), 1.0f));
+            sphere.radius = radius;
+            sphere.index = static_cast<GLuint>(i);
+            spheres.push_back(sphere);
+        }
+
+        binAll();
+        upload();
+        return true;
+    }
+
+    // bind the cluster textures and refresh the grid uniforms; the shader must be in use
+    void apply(const Shader& shader)
+    {
+        glActiveTexture(GL_TEXTURE0 + GRID_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, gridTexture);
+        glActiveTexture(GL_TEXTURE0 + INDEX_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+        glActiveTexture(GL_TEXTURE0);
+        if (uniformsDirty)
+        {
+            shader.set(clusterDimsUniform, glm::ivec3(TILES_X, TILES_Y, SLICES));
+            shader.set(clusterScaleUniform, clusterScale);
+            uniformsDirty = false;
+        }
+    }
+
+    // total light references over all clusters after the last rebuild
+    size_t lightReferences() const
+    {
+        return indices.size();
+    }
+
+private:
+    struct LightSphere
+    {
+        glm::vec3 center; // view space
+        float radius;
+        GLuint index;
+    };
+
+    struct Candidate
+    {
+        const LightSphere* sphere;
+        int x0, x1, y0, y1; // inclusive tile range
+    };
+
+    JobSystem& jobs;
+    std::vector<GLuint> grid;    // (offset, count) per cluster
+    std::vector<GLuint> indices; // light indices, grouped by cluster
+    std::vector<LightSphere> spheres;
+    std::vector<std::vector<GLuint> > sliceIndices;        // per slice, offsets relative to its start
+    std::vector<std::vector<Candidate> > threadCandidates; // per job thread, scratch
+
+    float tanHalfX = 1.0f, tanHalfY = 1.0f, zNear = 0.1f, depthRatio = 1000.0f;
+    glm::vec4 clusterScale;
+    bool uniformsDirty = true;
+    Uniform<glm::ivec3> clusterDimsUniform;
+    Uniform<glm::vec4> clusterScaleUniform;
+
+    glm::mat4 lastView;
+    glm::vec4 lastFrustum;
+    int lastViewportWidth = 0, lastViewportHeight = 0;
+    unsigned int lastLightUpload = ~0u;
+
+    // view-space depth (positive) where slice z begins
+    float sliceDepth(int z) const
+    {
+        return zNear * std::pow(depthRatio, static_cast<float>(z) / SLICES);
+    }
+
+    // smallest / largest value of v / d for d in [dNear, dFar]
+    static float minRatio(float v, float dNear, float dFar) { return v >= 0.0f ? v / dFar : v / dNear; }
+    static float maxRatio(float v, float dNear, float dFar) { return v >= 0.0f ? v / dNear : v / dFar; }
+
+    static int tileOf(float ratio, float tanHalf, int tiles)
+    {
+        // clamp before converting; unbounded lights give huge ratios
+        float tile = std::floor((ratio / tanHalf + 1.0f) * 0.5f * tiles);
+        return static_cast<int>(std::max(-1.0f, std::min(tile, static_cast<float>(tiles))));
+    }
+
+    static float distanceSquaredToRange(float v, float lo, float hi)
+    {
+        float d = v < lo ? lo - v : (v > hi ? v - hi : 0.0f);
+        return d * d;
+    }
+
+    // bin every slice as its own job; whichever thread takes a slice writes
+    // its light lists into the slice's index vector
+    void binAll()
+    {
+        jobs.parallelFor(SLICES, 1, [&](int begin, int end, unsigned int thread) {
+            for (int z = begin; z < end; ++z)
+                binSlice(z, sliceIndices[z], threadCandidates[thread]);
+        });
+
+        // concatenate the per-slice lists and rebase the offsets
+        indices.clear();
+        for (int z = 0; z < SLICES; ++z)
+        {
+            GLuint base = static_cast<GLuint>(indices.size());
+            for (int cluster = z * TILES_X * TILES_Y; cluster < (z + 1) * TILES_X * TILES_Y; ++cluster)
+                grid[2 * cluster] += base;
+            indices.insert(indices.end(), sliceIndices[z].begin(), sliceIndices[z].end());
+        }
+    }
+
+    void binSlice(int z, std::vector<GLuint>& out, std::vector<Candidate>& candidates)
+    {
+        out.clear();
+        float d0 = sliceDepth(z);
+        float d1 = sliceDepth(z + 1);
+
+        // lights reaching this slice, with the tile rectangle their sphere covers in it
+        candidates.clear();
+        for (const LightSphere& sphere : spheres)
+        {
+            float depth = -sphere.center.z;
+            if (depth + sphere.radius < d0 || depth - sphere.radius > d1)
+                continue;
+            float dNear = std::max(d0, depth - sphere.radius);
+            float dFar = std::min(d1, depth + sphere.radius);
+            Candidate candidate;
+            candidate.sphere = &sphere;
+            candidate.x0 = std::max(0, tileOf(minRatio(sphere.center.x - sphere.radius, dNear, dFar), tanHalfX, TILES_X));
+            candidate.x1 = std::min(TILES_X - 1, tileOf(maxRatio(sphere.center.x + sphere.radius, dNear, dFar), tanHalfX, TILES_X));
+            candidate.y0 = std::max(0, tileOf(minRatio(sphere.center.y - sphere.radius, dNear, dFar), tanHalfY, TILES_Y));
+            candidate.y1 = std::min(TILES_Y - 1, tileOf(maxRatio(sphere.center.y + sphere.radius, dNear, dFar), tanHalfY, TILES_Y));
+            if (candidate.x0 <= candidate.x1 && candidate.y0 <= candidate.y1)
+                candidates.push_back(candidate);
+        }
+
+        for (int y = 0; y < TILES_Y; ++y)
+        {
+            // cluster bounds in view space: the tile's side planes swept over [d0, d1]
+            float top0 = (-1.0f + 2.0f * y / TILES_Y) * tanHalfY;
+            float top1 = (-1.0f + 2.0f * (y + 1) / TILES_Y) * tanHalfY;
+            float minY = std::min(top0 * d0, top0 * d1), maxY = std::max(top1 * d0, top1 * d1);
+            for (int x = 0; x < TILES_X; ++x)
+            {
+                float side0 = (-1.0f + 2.0f * x / TILES_X) * tanHalfX;
+                float side1 = (-1.0f + 2.0f * (x + 1) / TILES_X) * tanHalfX;
+                float minX = std::min(side0 * d0, side0 * d1), maxX = std::max(side1 * d0, side1 * d1);
+
+                int cluster = x + TILES_X * (y + TILES_Y * z);
+                GLuint offset = static_cast<GLuint>(out.size());
+                for (const Candidate& candidate : candidates)
+                {
+                    if (x < candidate.x0 || x > candidate.x1 || y < candidate.y0 || y > candidate.y1)
+                        continue;
+                    const LightSphere& sphere = *candidate.sphere;
+                    float distanceSquared = distanceSquaredToRange(sphere.center.x, minX, maxX)
+                                          + distanceSquaredToRange(sphere.center.y, minY, maxY)
+                                          + distanceSquaredToRange(-sphere.center.z, d0, d1);
+                    if (distanceSquared <= sphere.radius * sphere.radius)
+                        out.push_back(sphere.index);
+                }
+                grid[2 * cluster] = offset;
+                grid[2 * cluster + 1] = static_cast<GLuint>(out.size()) - offset;
+            }
+        }
+    }
+
+    void upload()
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, gridTBO);
+        glBufferData(GL_TEXTURE_BUFFER, grid.size() * sizeof(GLuint), grid.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, indexTBO);
+        // never allocate an empty store; the shader won't read past the counts anyway
+        glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(indices.size(), 1) * sizeof(GLuint), indices.empty() ? nullptr : indices.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+};
+
+#endif
@@ -1,4 +1,11 @@
 // main.cpp
+#ifdef _WIN32
+// before glad, which would otherwise have APIENTRY defined when windows.h
+// (pulled in by mappedFile.h) defines it again
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
@@ -7,16 +14,40 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "shader.h"
+#include "shaderVariants.h"
 #include "camera.h"
+#include "simulation.h"
 #include "pointLight.h"
 #include "directionalLight.h"
-
+#include "lightBuffer.h"
+#include "lightClusters.h"
+#include "instancedRenderer.h"
+#include "sceneGraph.h"
+#include "sceneFile.h"
+#include "sceneCuller.h"
+#include "sphere.h"
+#include "mergedGeometry.h"
+#include "shadowMaps.h"
+#include "benchmarks.h"
+#include "headless.h"
+#include "fileWatcher.h"
+#include "cameraPath.h"
+#include "frameStats.h"
+#include "profiler.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
 
 using namespace std;
 
-bool rotateCeilingFan = false; // Fan rotation state
-float ceilingFanRotationAngle = 0.0f; // Fan rotation angle
+float ceilingFanRotationAngle = 0.0f; // Fan rotation angle, as last drawn
+vector<int> ceilingFanRotors; // Scene nodes spinning the fan blades
 
 
 // Function prototypes
@@ -25,23 +56,35 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
-void drawCube(unsigned int& cubeVAO, Shader& lightingShader, glm::mat4 model, glm::vec3 color);
-void drawRestaurant(unsigned int& cubeVAO, Shader& lightingShader);
-void drawCeilingFan(unsigned int& cubeVAO, Shader& lightingShader);
-void drawTable(unsigned int& cubeVAO, Shader& lightingShader, glm::vec3 position);
+void drawCube(SceneGraph& scene, int parent, glm::mat4 model, glm::vec3 color);
+void drawSphere(SceneGraph& scene, int parent, glm::mat4 model, glm::vec3 color);
+void drawRestaurant(SceneGraph& scene);
+void drawCeilingFan(SceneGraph& scene, float x, float z);
+glm::mat4 ceilingFanRotorTransform();
+void updateCeilingFan(SceneGraph& scene, float angle);
+void applySimulationState(const SimulationState& state, const SimulationState& shown);
+int drawTable(SceneGraph& scene, glm::vec3 position);
+void drawDiningTable(SceneGraph& scene, glm::vec3 position);
 
-void drawChair(unsigned int& cubeVAO, Shader& lightingShader, glm::vec3 position, float rotationAngle);
+void drawChair(SceneGraph& scene, int parent, glm::vec3 position, float rotationAngle);
 
-void drawLightSource(unsigned int& cubeVAO, Shader& lightingShader, glm::vec3 position, glm::vec3 color);
-void drawWalls(unsigned int& cubeVAO, Shader& lightingShader);
+void drawLightSource(SceneGraph& scene, glm::vec3 position, glm::vec3 color);
+void drawWalls(SceneGraph& scene);
 
 
 // Function prototypes for additional features
-void drawWallArt(unsigned int& cubeVAO, Shader& lightingShader);
-void drawShelf(unsigned int& cubeVAO, Shader& lightingShader);
-void drawTableSettings(unsigned int& cubeVAO, Shader& lightingShader, glm::vec3 tablePosition);
-void drawPendantLight(unsigned int& cubeVAO, Shader& lightingShader);
-void drawWindows(unsigned int& cubeVAO, Shader& lightingShader);
+void drawWallArt(SceneGraph& scene);
+void drawShelf(SceneGraph& scene);
+void drawTableSettings(SceneGraph& scene, int table);
+void drawPendantLight(SceneGraph& scene, float x, float z);
+void drawWindows(SceneGraph& scene);
+void buildScene(SceneGraph& scene);
+struct VenueLayout;
+void buildVenue(SceneGraph& scene, const VenueLayout& venue, vector<SceneLight>& venueLights);
+bool loadScene(SceneGraph& scene, SceneFile& file, const string& path, const VenueLayout* venue);
+glm::vec2 spreadEvenly(int i, int count, float width, float depth);
+vector<SceneLight> sceneLights();
+void applySceneLights(const vector<SceneLight>& fileLights);
 
 
 // Add these helper function prototypes
@@ -56,6 +99,25 @@ void setSpecularLighting(bool state);
 // Settings
 const unsigned int SCR_WIDTH = 1000;
 const unsigned int SCR_HEIGHT = 800;
+int framebufferWidth = SCR_WIDTH; // actual viewport size, kept current by framebuffer_size_callback
+int framebufferHeight = SCR_HEIGHT;
+
+// Dining tables; each gets four chairs and a table setting
+const glm::vec3 tablePositions[] = {
+    glm::vec3(-3.0f, 0.5f, -3.0f),
+    glm::vec3(3.0f, 0.5f, -3.0f),
+    glm::vec3(-3.0f, 0.5f, 3.0f),
+    glm::vec3(3.0f, 0.5f, 3.0f)
+};
+
+// Generated food-court sized venue for scaling tests (--venue)
+struct VenueLayout
+{
+    int tables = 0; // each with four chairs and a table setting
+    int rows = 1;   // tables are laid out in this many rows
+    int lights = 0; // point lights, each hanging in a pendant
+    int fans = 0;
+};
 
 // Camera
 Camera camera(glm::vec3(0.0f, 3.0f, 10.0f));
@@ -63,9 +125,49 @@ float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
-// Timing
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
+// Camera movement, the fan and the light switches; input callbacks feed it
+Simulation* simulation = NULL;
+
+// Uniform handles for a Phong shader variant, resolved once after linking
+struct PhongUniforms
+{
+    Uniform<glm::mat4> view;
+    Uniform<glm::mat4> projection;
+    Uniform<glm::vec3> viewPos;
+    Uniform<bool> bakedLighting;
+
+    // also points the program's samplers and light block at their bindings
+    void resolve(Shader& shader)
+    {
+        view = shader.uniform<glm::mat4>("view");
+        projection = shader.uniform<glm::mat4>("projection");
+        viewPos = shader.uniform<glm::vec3>("viewPos");
+        bakedLighting = shader.uniform<bool>("bakedLighting");
+
+        shader.bindUniformBlock("Lights", LightBuffer::BINDING);
+        shader.use();
+        shader.set(shader.uniform<int>("pointLightData"), (int)LightBuffer::POINT_LIGHT_UNIT);
+        shader.set(shader.uniform<int>("clusterGrid"), (int)LightClusters::GRID_UNIT);
+        shader.set(shader.uniform<int>("clusterLightIndices"), (int)LightClusters::INDEX_UNIT);
+        shader.set(shader.uniform<int>("materialData"), (int)MaterialLibrary::TEXTURE_UNIT);
+        for (int i = 0; i < ShadowMaps::MAX_POINT_LIGHTS; ++i)
+            shader.set(shader.uniform<int>("pointShadowMaps[" + to_string(i) + "]"), (int)(ShadowMaps::FIRST_POINT_UNIT + i));
+        shader.set(shader.uniform<int>("directionalShadowMap"), (int)ShadowMaps::DIRECTIONAL_UNIT);
+    }
+};
+
+// Features of fragmentShaderForPhongShading.fs, as bits of a variant key
+enum PhongFeature
+{
+    PHONG_DIRECTIONAL_LIGHT = 1 << 0,
+    PHONG_POINT_LIGHTS = 1 << 1,
+    PHONG_AMBIENT = 1 << 2,
+    PHONG_DIFFUSE = 1 << 3,
+    PHONG_SPECULAR = 1 << 4,
+    PHONG_SHADOWS = 1 << 5
+};
+const vector<string> phongFeatureNames = { "DIRECTIONAL_LIGHT", "POINT_LIGHTS", "AMBIENT", "DIFFUSE", "SPECULAR", "SHADOWS" };
+unsigned int phongVariantKey();
 
 
 DirectionalLight directionalLight(
@@ -112,6 +214,13 @@ PointLight pointlight3(
     3                   // ID
 );
 
+// Point lights the scene uses; a scene file replaces the three above and may add more
+vector<PointLight*> scenePointLights = { &pointlight1, &pointlight2, &pointlight3 };
+vector<unique_ptr<PointLight>> extraPointLights;
+
+// The directional light and the first point lights cast shadows, unless --no-shadows
+bool shadowsEnabled = true;
+
 
 
 
@@ -124,175 +233,492 @@ PointLight pointlight3(
 
 
 // Render scene
-int main()
+int main(int argc, char** argv)
 {
-    // Initialize GLFW
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    // Create window
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "3D Restaurant", NULL, NULL);
-    if (!window)
+    chrono::high_resolution_clock::time_point launched = chrono::high_resolution_clock::now();
+
+    // --headless [--frames N] [--warmup N] [--out file.json]: render the scripted
+    // camera tour offscreen and write frame-time statistics instead of opening a window
+    bool headless = false;
+    int benchmarkFrames = 600;
+    int warmupFrames = 30;
+    string statsPath = "frame_stats.json";
+    string profileCsvPath, tracePath; // --profile-csv / --trace: per-frame timings written on exit
+    bool floatVertices = false;       // --float-vertices: keep 24-byte float vertices, for comparison
+    string scenePath;                 // --scene: text or compiled scene file instead of the built-in layout
+    string exportScenePath, compileScenePath; // --export-scene / --compile-scene: write the scene and exit
+    VenueLayout venue;                // --venue TABLES ROWS LIGHTS FANS: generated venue instead of the restaurant
+    bool generateVenue = false;
+    bool shaderCache = true;          // --no-shader-cache: always compile shaders from source
+    unsigned int jobThreads = 0;      // --threads N: threads generating render commands and binning lights, 0 for one per core
+    bool orphanStreaming = false;     // --orphan-streaming: stream instances by orphaning even with persistent mapping
+    bool lightBake = true;            // --no-light-bake: light the shell per fragment instead of baking ambient and diffuse
+    bool benchNormalMatrix = false;   // --bench-normal-matrix: compare per-vertex vs. per-instance normal matrices and exit
+    for (int i = 1; i < argc; ++i)
     {
-        cout << "Failed to create GLFW window" << endl;
-        glfwTerminate();
-        return -1;
+        string arg = argv[i];
+        if (arg == "--headless")
+            headless = true;
+        else if (arg == "--frames" && i + 1 < argc)
+            benchmarkFrames = max(1, atoi(argv[++i]));
+        else if (arg == "--warmup" && i + 1 < argc)
+            warmupFrames = max(0, atoi(argv[++i]));
+        else if (arg == "--out" && i + 1 < argc)
+            statsPath = argv[++i];
+        else if (arg == "--profile-csv" && i + 1 < argc)
+            profileCsvPath = argv[++i];
+        else if (arg == "--trace" && i + 1 < argc)
+            tracePath = argv[++i];
+        else if (arg == "--float-vertices")
+            floatVertices = true;
+        else if (arg == "--scene" && i + 1 < argc)
+            scenePath = argv[++i];
+        else if (arg == "--export-scene" && i + 1 < argc)
+            exportScenePath = argv[++i];
+        else if (arg == "--compile-scene" && i + 1 < argc)
+            compileScenePath = argv[++i];
+        else if (arg == "--no-shader-cache")
+            shaderCache = false;
+        else if (arg == "--threads" && i + 1 < argc)
+            jobThreads = static_cast<unsigned int>(max(0, atoi(argv[++i])));
+        else if (arg == "--orphan-streaming")
+            orphanStreaming = true;
+        else if (arg == "--no-light-bake")
+            lightBake = false;
+        else if (arg == "--no-shadows")
+            shadowsEnabled = false;
+        else if (arg == "--bench-normal-matrix")
+            benchNormalMatrix = true;
+        else if (arg == "--venue" && i + 4 < argc)
+        {
+            generateVenue = true;
+            venue.tables = max(0, atoi(argv[++i]));
+            venue.rows = max(1, atoi(argv[++i]));
+            venue.lights = max(0, atoi(argv[++i]));
+            venue.fans = max(0, atoi(argv[++i]));
+        }
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetKeyCallback(window, key_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-
-    // Initialize GLAD
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-        cout << "Failed to initialize GLAD" << endl;
+
+    // The restaurant as a node hierarchy, built in code or loaded from a
+    // scene file. Everything outside the fan rotor is baked once; each frame
+    // only the objects inside the view frustum are drawn.
+    SceneGraph scene;
+    SceneFile sceneFile; // keeps a compiled scene mapped
+    if (!loadScene(scene, sceneFile, scenePath, generateVenue ? &venue : NULL))
         return -1;
+    if (!exportScenePath.empty() || !compileScenePath.empty())
+    {
+        if (!exportScenePath.empty() && !SceneFile::saveText(exportScenePath, scene, sceneLights()))
+        {
+            cout << "Failed to write " << exportScenePath << endl;
+            return -1;
+        }
+        if (!compileScenePath.empty() && !SceneFile::saveCompiled(compileScenePath, scene, sceneLights()))
+        {
+            cout << "Failed to write " << compileScenePath << endl;
+            return -1;
+        }
+        return 0;
     }
 
-    // Enable depth testing
-    glEnable(GL_DEPTH_TEST);
-
-    // Compile shaders
-    Shader lightingShader("vertexShaderForPhongShading.vs", "fragmentShaderForPhongShading.fs");
-
-    // Set up cube VAO
-    float cubeVertices[] = {
-        // Positions         // Normals
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-         0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-         0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f
-    };
-    unsigned int cubeIndices[] = {
-        0, 1, 2, 2, 3, 0,
-        4, 5, 6, 6, 7, 4,
-        0, 4, 7, 7, 3, 0,
-        1, 5, 6, 6, 2, 1,
-        0, 1, 5, 5, 4, 0,
-        3, 2, 6, 6, 7, 3
-    };
-    unsigned int cubeVAO, cubeVBO, cubeEBO;
-    glGenVertexArrays(1, &cubeVAO);
-    glGenBuffers(1, &cubeVBO);
-    glGenBuffers(1, &cubeEBO);
+    if (!shaderCache)
+        ProgramCache::get().setDirectory("");
 
-    glBindVertexArray(cubeVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
+    Profiler& profiler = Profiler::get();
+    profiler.setRecording(!profileCsvPath.empty() || !tracePath.empty());
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cubeIndices), cubeIndices, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    while (!glfwWindowShouldClose(window))
+    GLFWwindow* window = NULL;
+    HeadlessContext offscreen;
+    if (headless)
     {
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-        processInput(window);
-
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        lightingShader.use();
-        lightingShader.setVec3("viewPos", camera.Position);
-
-        // Setup lighting
-        directionalLight.setUpLight(lightingShader);
-        pointlight1.setUpPointLight(lightingShader);
-        pointlight2.setUpPointLight(lightingShader);
-        pointlight3.setUpPointLight(lightingShader); // Activate blue point light
-
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-        lightingShader.setMat4("projection", projection);
-        lightingShader.setMat4("view", view);
-
-        // Draw restaurant floor
-        drawRestaurant(cubeVAO, lightingShader);
-
-        // Draw walls
-        drawWalls(cubeVAO, lightingShader);
+        if (!offscreen.create(SCR_WIDTH, SCR_HEIGHT))
+            return -1;
+    }
+    else
+    {
+        // Initialize GLFW
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        // Create window
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "3D Restaurant", NULL, NULL);
+        if (!window)
+        {
+            cout << "Failed to create GLFW window" << endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        glfwSetKeyCallback(window, key_callback);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+        // Initialize GLAD
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        {
+            cout << "Failed to initialize GLAD" << endl;
+            return -1;
+        }
+        GLExtensions::load((GLADloadproc)glfwGetProcAddress);
+    }
 
-        // Draw light source cubes
-        drawLightSource(cubeVAO, lightingShader, glm::vec3(4.0f, 5.0f, -4.0f), glm::vec3(1.0f, 0.5f, 1.0f)); // Pink light source
-        drawLightSource(cubeVAO, lightingShader, glm::vec3(-4.0f, 5.0f, -4.0f), glm::vec3(1.0f, 1.0f, 1.0f)); // White light source
-        drawLightSource(cubeVAO, lightingShader, glm::vec3(0.0f, 4.0f, 3.0f), glm::vec3(0.0f, 0.0f, 1.0f)); 
+    // Enable depth testing
+    glEnable(GL_DEPTH_TEST);
 
+    if (benchNormalMatrix)
+    {
+        runNormalMatrixBenchmark();
+        offscreen.destroy();
+        glfwTerminate();
+        return 0;
+    }
 
-        // Draw pendant light in the dark area
-        drawPendantLight(cubeVAO, lightingShader);
+    // Everything that owns GL objects lives in this block, so it is released
+    // while the context is still current
+    {
+        // Compile shaders. The Phong shader comes in variants that leave out the
+        // lights and terms that currently contribute nothing; see phongVariantKey()
+        ShaderVariants<PhongUniforms> phongVariants("vertexShaderForPhongShading.vs", "fragmentShaderForPhongShading.fs", phongFeatureNames);
+        unsigned int phongKey = phongVariantKey();
+        ShaderVariants<PhongUniforms>::Variant& firstVariant = phongVariants.get(phongKey);
+        Shader* lightingShader = firstVariant.shader.get();
+        PhongUniforms* phong = &firstVariant.uniforms;
+
+        // Hot reload: saving a Phong source rebuilds the cached variants in the
+        // background while the old programs keep drawing. Drivers without
+        // parallel shader compile get a hidden context to build on instead.
+        FileWatcher shaderWatcher;
+        unique_ptr<ShaderBuilder> shaderBuilder;
+        GLFWwindow* shaderBuilderContext = NULL;
+        if (!headless)
+        {
+            shaderWatcher.watch("vertexShaderForPhongShading.vs");
+            shaderWatcher.watch("fragmentShaderForPhongShading.fs");
+            if (!GLExtensions::get().parallelShaderCompile)
+            {
+                glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+                shaderBuilderContext = glfwCreateWindow(1, 1, "", NULL, window);
+                glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+            }
+            shaderBuilder.reset(new ShaderBuilder(shaderBuilderContext));
+        }
 
-        glm::vec3 tablePositions[] = {
-        glm::vec3(-3.0f, 0.5f, -3.0f),
-        glm::vec3(3.0f, 0.5f, -3.0f),
-        glm::vec3(-3.0f, 0.5f, 3.0f),
-        glm::vec3(3.0f, 0.5f, 3.0f)
+        // All lights live in one uniform buffer, re-uploaded only when one of them changes
+        LightBuffer lights;
+        lights.setDirectionalLight(&directionalLight);
+        for (PointLight* light : scenePointLights)
+            lights.addPointLight(light);
+
+        JobSystem jobs(jobThreads); // the GL thread plus workers, for per-node work and light binning every frame
+
+        // Point lights are binned into view-space clusters; each fragment only
+        // shades the lights of its own cluster
+        LightClusters lightClusters(jobs);
+        lightClusters.resolveUniforms(*lightingShader);
+
+        // Cube mesh, in the packed vertex layout unless --float-vertices
+        const vector<float> cubeVertices = {
+            // Positions         // Normals
+            -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+             0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+             0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+            -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+            -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+             0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+             0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+            -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f
         };
-
-        for (glm::vec3 tablePos : tablePositions)
+        const vector<unsigned int> cubeIndices = {
+            0, 1, 2, 2, 3, 0,
+            4, 5, 6, 6, 7, 4,
+            0, 4, 7, 7, 3, 0,
+            1, 5, 6, 6, 2, 1,
+            0, 1, 5, 5, 4, 0,
+            3, 2, 6, 6, 7, 3
+        };
+        MeshBuffer cubeMesh(cubeVertices, cubeIndices, !floatVertices);
+
+        scene.materials.upload(); // every material the scene uses, in one buffer texture
+        SceneCuller culler(scene, jobs);
+
+        // Walls, floor and wall decorations: one buffer, one multi-draw call, with
+        // the ambient and diffuse light of the fixed lights baked in every 0.25 units
+        MergedGeometry shell(cubeVertices, cubeIndices, !floatVertices, lightBake ? 0.25f : 0.0f);
+        vector<int> visibleShell;
+        double titleUpdatedMs = -1.0e9;
+
+        // One static and one dynamic batch per mesh: the cube and every sphere
+        // level of detail. Static batches are re-uploaded only when their visible
+        // set changes; moving objects are gathered every frame. Both stream their
+        // instances through persistently mapped buffers where available.
+        StreamBuffer::orphaningForced() = orphanStreaming;
+        SphereLODs sphereLODs(!floatVertices);
+        vector<unique_ptr<InstancedRenderer>> staticBatches, dynamicBatches;
+        for (int mesh = 0; mesh < SceneCuller::MESH_COUNT; ++mesh)
         {
-            drawTable(cubeVAO, lightingShader, tablePos);
-
-            float chairDistance = 1.6f;
-
-            // Draw chairs with backrests positioned at the rear edge
-            drawChair(cubeVAO, lightingShader, tablePos + glm::vec3(chairDistance, 0.0f, 0.0f), -90.0f); // Right chair facing center
-            drawChair(cubeVAO, lightingShader, tablePos + glm::vec3(-chairDistance, 0.0f, 0.0f), 90.0f); // Left chair facing center
-            drawChair(cubeVAO, lightingShader, tablePos + glm::vec3(0.0f, 0.0f, chairDistance), 180.0f); // Back chair facing center
-            drawChair(cubeVAO, lightingShader, tablePos + glm::vec3(0.0f, 0.0f, -chairDistance), 0.0f);  // Front chair facing center
+            for (int dynamic = 0; dynamic < 2; ++dynamic)
+            {
+                InstancedRenderer* batch;
+                if (mesh == 0)
+                    batch = new InstancedRenderer(cubeMesh);
+                else
+                    batch = new InstancedRenderer(sphereLODs.mesh, sphereLODs.levels[mesh - 1].indexCount, sphereLODs.levels[mesh - 1].firstIndex);
+                (dynamic ? dynamicBatches : staticBatches).push_back(unique_ptr<InstancedRenderer>(batch));
+            }
         }
 
-
-
-
-
-        // Inside the render loop, callimg  these functions
-        drawWallArt(cubeVAO, lightingShader);
-        drawShelf(cubeVAO, lightingShader);
-        for (glm::vec3 tablePos : tablePositions)
+        // Shadow maps: static depth is rendered once per light and cached, the
+        // fan blades are drawn over a copy of it every frame
+        unique_ptr<ShadowMaps> shadowMaps;
+        if (shadowsEnabled)
         {
-            drawTable(cubeVAO, lightingShader, tablePos);
-            drawTableSettings(cubeVAO, lightingShader, tablePos);
+            shadowMaps.reset(new ShadowMaps(cubeMesh, sphereLODs));
+            shadowMaps->resolveUniforms(*lightingShader);
         }
-      
-        drawWindows(cubeVAO, lightingShader);
-
-        // Draw pendant light in the front part
-        drawPendantLight(cubeVAO, lightingShader);
 
+        // Cold starts compile every shader; warm starts load their binaries from the program cache
+        const ProgramCache::Stats& shaderStats = ProgramCache::get().stats;
+        cout << "Startup: " << chrono::duration<double, milli>(chrono::high_resolution_clock::now() - launched).count()
+             << " ms, shaders " << shaderStats.milliseconds << " ms (" << shaderStats.hits << " from program cache, "
+             << shaderStats.misses << " compiled" << (ProgramCache::get().enabled() ? "" : ", cache off") << ")" << endl;
+
+        // The simulation ticks at a fixed rate on its own thread, so a slow frame
+        // never slows it down. Headless runs instead step it once per frame and
+        // replay the same camera tour with the fan spinning, so every run renders
+        // exactly the same frames
+        SimulationState shown;
+        shown.cameraPosition = camera.Position;
+        shown.cameraYaw = camera.Yaw;
+        shown.cameraPitch = camera.Pitch;
+        shown.cameraZoom = camera.Zoom;
+        SimulationState initial = shown;
+        initial.fanSpinning = headless;
+        Simulation restaurantSimulation(camera, initial, headless ? 1.0 / 60.0 : 1.0 / 120.0);
+        simulation = &restaurantSimulation;
+        if (!headless)
+            restaurantSimulation.start();
+        CameraPath tour = CameraPath::restaurantTour();
+        FrameStats frameStats;
+        int frameIndex = 0;
+
+        while (headless ? frameIndex < warmupFrames + benchmarkFrames : !glfwWindowShouldClose(window))
+        {
+            chrono::high_resolution_clock::time_point frameStart = chrono::high_resolution_clock::now();
+            profiler.beginFrame();
+            {
+                CpuTimer timer("input");
+                if (headless)
+                    restaurantSimulation.step();
+                else
+                    processInput(window);
+                SimulationState state = headless ? restaurantSimulation.latest().current : restaurantSimulation.interpolated();
+                applySimulationState(state, shown);
+                shown = state;
+                if (headless)
+                {
+                    int measured = max(0, frameIndex - warmupFrames);
+                    tour.apply(camera, tour.duration() * measured / max(1, benchmarkFrames - 1));
+                }
+
+                // Edited shader sources rebuild in the background; finished programs swap in here
+                bool reloaded = false;
+                if (shaderBuilder)
+                {
+                    vector<string> changed = shaderWatcher.changedFiles();
+                    if (!changed.empty())
+                    {
+                        cout << "Reloading " << changed[0] << (changed.size() > 1 ? " (and more)" : "") << " with " << shaderBuilder->modeName() << endl;
+                        phongVariants.reload(*shaderBuilder);
+                    }
+                    reloaded = phongVariants.update(*shaderBuilder);
+                }
+                // Light keys (B/N/C/V/1-6) switch to the variant for the new light state;
+                // resolving its uniforms happens here, before lookups are counted
+                unsigned int key = phongVariantKey();
+                if (key != phongKey || reloaded)
+                {
+                    phongKey = key;
+                    ShaderVariants<PhongUniforms>::Variant& variant = phongVariants.get(key);
+                    lightingShader = variant.shader.get();
+                    phong = &variant.uniforms;
+                    lightClusters.resolveUniforms(*lightingShader);
+                    if (shadowMaps)
+                        shadowMaps->resolveUniforms(*lightingShader);
+                }
+            }
+            Shader::beginFrame();
+
+            glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            lightingShader->use();
+            lightingShader->set(phong->viewPos, camera.Position);
+
+            float aspect = (float)SCR_WIDTH / (float)SCR_HEIGHT;
+            glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), aspect, 0.1f, 100.0f);
+            glm::mat4 view = camera.GetViewMatrix();
+            lightingShader->set(phong->projection, projection);
+            lightingShader->set(phong->view, view);
+
+            {
+                CpuTimer timer("lights");
+                // Key presses only mark lights dirty; they are uploaded here at most once a frame
+                lights.update();
+                lightClusters.update(lights, view, glm::radians(camera.Zoom), aspect, 0.1f, 100.0f, framebufferWidth, framebufferHeight);
+                lights.bindTextures();
+                scene.materials.bindTexture();
+                lightClusters.apply(*lightingShader);
+            }
+
+            const CullStats* cullStats;
+            {
+                CpuTimer timer("cull");
+                // Only the fan rotor moves; updateWorld() refreshes just its subtree
+                updateCeilingFan(scene, shown.fanAngle);
+                scene.updateWorld();
+                shell.update(scene);
+                culler.refitDynamic();
+                cullStats = &culler.cull(projection * view);
+                profiler.setCullCounts(cullStats->visible, cullStats->culled);
+            }
+            {
+                CpuTimer timer("lightBake");
+                // only after a light was switched or the shell rebuilt
+                LightBaker::Shadowed shadowed;
+                shadowed.directional = shadowsEnabled;
+                shadowed.pointLights = shadowsEnabled ? ShadowMaps::shadowedPointLights(scenePointLights.size()) : 0;
+                shell.bakeLighting(scene.materials, directionalLight, scenePointLights, jobs, shadowed);
+            }
+            if (shadowMaps)
+            {
+                CpuTimer timer("shadows");
+                GpuTimer gpuTimer("shadows");
+                shadowMaps->update(scene, shell, directionalLight, scenePointLights);
+                lightingShader->use();
+                shadowMaps->apply(*lightingShader, scenePointLights.size());
+            }
+            {
+                CpuTimer timer("renderList");
+                float pixelsPerUnit = framebufferHeight / (2.0f * tan(glm::radians(camera.Zoom) / 2.0f));
+                culler.buildRenderList(view, pixelsPerUnit);
+            }
+
+            {
+                CpuTimer timer("drawShell");
+                GpuTimer gpuTimer("drawShell");
+                culler.gatherMerged(visibleShell);
+                lightingShader->set(phong->bakedLighting, shell.isBaked());
+                shell.draw(visibleShell);
+                lightingShader->set(phong->bakedLighting, false);
+            }
+            {
+                CpuTimer timer("drawStatic");
+                GpuTimer gpuTimer("drawStatic");
+                for (int mesh = 0; mesh < SceneCuller::MESH_COUNT; ++mesh)
+                {
+                    culler.gatherStatic(mesh, *staticBatches[mesh]);
+                    staticBatches[mesh]->draw();
+                }
+            }
+            {
+                CpuTimer timer("drawDynamic");
+                GpuTimer gpuTimer("drawDynamic");
+                for (int mesh = 0; mesh < SceneCuller::MESH_COUNT; ++mesh)
+                {
+                    culler.gatherDynamic(mesh, *dynamicBatches[mesh]);
+                    if (dynamicBatches[mesh]->instanceCount() > 0)
+                        dynamicBatches[mesh]->flush();
+                }
+            }
+
+            // frame times and culling results in the title bar, a few times a second
+            double nowMs = profiler.now();
+            if (window && nowMs - titleUpdatedMs > 250.0)
+            {
+                titleUpdatedMs = nowMs;
+                const Profiler::FrameRecord& timing = profiler.latest();
+                char title[200];
+                snprintf(title, sizeof(title), "3D Restaurant - CPU %.2f ms, GPU %.2f ms - %d visible, %d culled - %llu upload stalls",
+                         timing.cpuMs, timing.gpuMs, cullStats->visible, cullStats->culled, StreamBuffer::stats().stalls);
+                glfwSetWindowTitle(window, title);
+            }
+
+            // the render loop must not resolve uniforms by name
+            unsigned int stringLookups = Shader::stringLookupsThisFrame();
+            if (stringLookups != 0)
+                cout << "WARNING: " << stringLookups << " string-based uniform lookups this frame" << endl;
+
+            if (headless)
+            {
+                // wait for the GPU so the sample covers the whole frame, not just submission
+                {
+                    CpuTimer timer("finish");
+                    glFinish();
+                }
+                profiler.endFrame();
+                double frameMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - frameStart).count();
+                if (frameIndex >= warmupFrames)
+                    frameStats.add(frameMs, cullStats->visible, cullStats->culled);
+            }
+            else
+            {
+                {
+                    CpuTimer timer("swap");
+                    glfwSwapBuffers(window);
+                    glfwPollEvents();
+                }
+                profiler.endFrame();
+            }
+            ++frameIndex;
+        }
 
+        profiler.flush();
+        if (!profileCsvPath.empty() && !profiler.writeCsv(profileCsvPath))
+            cout << "Failed to write " << profileCsvPath << endl;
+        if (!tracePath.empty() && !profiler.writeChromeTrace(tracePath))
+            cout << "Failed to write " << tracePath << endl;
 
+        if (headless)
+        {
+            FrameStats::Summary summary = frameStats.summarize();
+            vector<string> info;
+            info.push_back("\"renderer\": \"" + string((const char*)glGetString(GL_RENDERER)) + "\"");
+            info.push_back("\"width\": " + to_string(SCR_WIDTH));
+            info.push_back("\"height\": " + to_string(SCR_HEIGHT));
+            info.push_back("\"warmup_frames\": " + to_string(warmupFrames));
+            info.push_back("\"scene_nodes\": " + to_string(scene.size()));
+            info.push_back("\"job_threads\": " + to_string(jobs.threadCount()));
+            const StreamBuffer::Stats& streamStats = StreamBuffer::stats();
+            info.push_back("\"stream_mode\": \"" + string(staticBatches[0]->streamsPersistently() ? "persistent" : "orphan") + "\"");
+            info.push_back("\"stream_uploads\": " + to_string(streamStats.uploads));
+            info.push_back("\"stream_stalls\": " + to_string(streamStats.stalls));
+            info.push_back("\"stream_stall_ms\": " + to_string(streamStats.stallMilliseconds));
+            if (shadowMaps)
+            {
+                info.push_back("\"shadow_static_renders\": " + to_string(shadowMaps->stats().staticRenders));
+                info.push_back("\"shadow_composited_faces\": " + to_string(shadowMaps->stats().compositedFaces));
+            }
+            if (!frameStats.writeJson(statsPath, info))
+                cout << "Failed to write " << statsPath << endl;
+            cout << "Headless run: " << summary.frames << " frames, mean " << summary.mean << " ms, p50 " << summary.p50
+                 << " ms, p95 " << summary.p95 << " ms, p99 " << summary.p99 << " ms, " << streamStats.stalls << " of "
+                 << streamStats.uploads << " instance uploads stalled (" << statsPath << ")" << endl;
+        }
 
-        drawCeilingFan(cubeVAO, lightingShader);
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        restaurantSimulation.stop();
+        simulation = NULL;
+        shaderBuilder.reset(); // joins the worker before its context goes away
+        if (shaderBuilderContext)
+            glfwDestroyWindow(shaderBuilderContext);
     }
-
-
-
-
-    // Cleanup
-    glDeleteVertexArrays(1, &cubeVAO);
-    glDeleteBuffers(1, &cubeVBO);
-    glDeleteBuffers(1, &cubeEBO);
-
+    scene.materials.release(); // the scene itself outlives the block
+    offscreen.destroy();
     glfwTerminate();
     return 0;
 }
@@ -300,6 +726,8 @@ int main()
 // Utility and drawing functions go here...
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
+    framebufferWidth = width;
+    framebufferHeight = height;
     glViewport(0, 0, width, height);
 }
 
@@ -322,12 +750,14 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
     lastX = xpos;
     lastY = ypos;
 
-    camera.ProcessMouseMovement(static_cast<float>(xoffset), static_cast<float>(yoffset));
+    if (simulation)
+        simulation->mouseMoved(static_cast<float>(xoffset), static_cast<float>(yoffset));
 }
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
-    camera.ProcessMouseScroll(static_cast<float>(yoffset));
+    if (simulation)
+        simulation->scrolled(static_cast<float>(yoffset));
 }
 
 void processInput(GLFWwindow* window)
@@ -335,18 +765,22 @@ void processInput(GLFWwindow* window)
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
+    // Movement keys are sampled here and applied by the simulation every tick
+    unsigned int moves = 0;
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        camera.ProcessKeyboard(FORWARD, deltaTime);
+        moves |= 1u << FORWARD;
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        camera.ProcessKeyboard(BACKWARD, deltaTime);
+        moves |= 1u << BACKWARD;
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        camera.ProcessKeyboard(LEFT, deltaTime);
+        moves |= 1u << LEFT;
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        camera.ProcessKeyboard(RIGHT, deltaTime);
+        moves |= 1u << RIGHT;
     if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-        camera.ProcessKeyboard(UP, deltaTime);
+        moves |= 1u << UP;
     if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-        camera.ProcessKeyboard(DOWN, deltaTime);
+        moves |= 1u << DOWN;
+    if (simulation)
+        simulation->setHeldMoves(moves);
 }
 
 
@@ -354,150 +788,413 @@ void processInput(GLFWwindow* window)
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
-    if (action == GLFW_PRESS) {
-        // Directional Light Controls
-        if (key == GLFW_KEY_B) {
+    // Light (B/N/C/V/1-6) and fan (J/K) controls take effect on the next simulation tick
+    if (action == GLFW_PRESS && simulation)
+        simulation->keyPressed(key);
+}
+
+// Bring the render-side camera, fan and lights up to a simulation snapshot.
+// Lights are only touched when a switch changed, since that marks them dirty
+void applySimulationState(const SimulationState& state, const SimulationState& shown)
+{
+    camera.Position = state.cameraPosition;
+    camera.Yaw = state.cameraYaw;
+    camera.Pitch = state.cameraPitch;
+    camera.Zoom = state.cameraZoom;
+    camera.ProcessMouseMovement(0.0f, 0.0f); // recompute Front/Right/Up
+
+    // Directional Light Controls
+    if (state.directionalLight != shown.directionalLight) {
+        if (state.directionalLight)
             directionalLight.turnOn();
-        }
-        else if (key == GLFW_KEY_N) {
+        else
             directionalLight.turnOff();
-        }
+    }
 
-        // Point Light Controls
-        if (key == GLFW_KEY_C) {
-            pointlight1.turnOn();
-            pointlight2.turnOn();
-            pointlight3.turnOn();
-        }
-        else if (key == GLFW_KEY_V) {
-            pointlight1.turnOff();
-            pointlight2.turnOff();
-            pointlight3.turnOff();
+    // Point Light Controls
+    if (state.pointLights != shown.pointLights) {
+        for (PointLight* light : scenePointLights) {
+            if (state.pointLights)
+                light->turnOn();
+            else
+                light->turnOff();
         }
+    }
 
-        // Ambient Light Controls
-        if (key == GLFW_KEY_1) {
+    // Ambient Light Controls
+    if (state.ambient != shown.ambient) {
+        if (state.ambient)
             directionalLight.turnAmbientOn();
-            pointlight1.turnAmbientOn();
-            pointlight2.turnAmbientOn();
-            pointlight3.turnAmbientOn();
-        }
-        else if (key == GLFW_KEY_2) {
+        else
             directionalLight.turnAmbientOff();
-            pointlight1.turnAmbientOff();
-            pointlight2.turnAmbientOff();
-            pointlight3.turnAmbientOff();
+        for (PointLight* light : scenePointLights) {
+            if (state.ambient)
+                light->turnAmbientOn();
+            else
+                light->turnAmbientOff();
         }
+    }
 
-        // Diffuse Light Controls
-        if (key == GLFW_KEY_3) {
+    // Diffuse Light Controls
+    if (state.diffuse != shown.diffuse) {
+        if (state.diffuse)
             directionalLight.turnDiffuseOn();
-            pointlight1.turnDiffuseOn();
-            pointlight2.turnDiffuseOn();
-            pointlight3.turnDiffuseOn();
-        }
-        else if (key == GLFW_KEY_4) {
+        else
             directionalLight.turnDiffuseOff();
-            pointlight1.turnDiffuseOff();
-            pointlight2.turnDiffuseOff();
-            pointlight3.turnDiffuseOff();
+        for (PointLight* light : scenePointLights) {
+            if (state.diffuse)
+                light->turnDiffuseOn();
+            else
+                light->turnDiffuseOff();
         }
+    }
 
-        // Specular Light Controls
-        if (key == GLFW_KEY_5) {
+    // Specular Light Controls
+    if (state.specular != shown.specular) {
+        if (state.specular)
             directionalLight.turnSpecularOn();
-            pointlight1.turnSpecularOn();
-            pointlight2.turnSpecularOn();
-            pointlight3.turnSpecularOn();
-        }
-        else if (key == GLFW_KEY_6) {
+        else
             directionalLight.turnSpecularOff();
-            pointlight1.turnSpecularOff();
-            pointlight2.turnSpecularOff();
-            pointlight3.turnSpecularOff();
+        for (PointLight* light : scenePointLights) {
+            if (state.specular)
+                light->turnSpecularOn();
+            else
+                light->turnSpecularOff();
         }
+    }
+}
+
 
-        // Ceiling Fan Controls
-        if (key == GLFW_KEY_J) {
-            rotateCeilingFan = true; // Start rotation
-        }
-        else if (key == GLFW_KEY_K) {
-            rotateCeilingFan = false; // Stop rotation
-        }
+
+
+
+void drawCube(SceneGraph& scene, int parent, glm::mat4 model, glm::vec3 color)
+{
+    scene.addCube(parent, model, scene.materials.intern(color, glm::vec3(0.5f), 32.0f));
+}
+
+// a sphere filling the same box the cube would
+void drawSphere(SceneGraph& scene, int parent, glm::mat4 model, glm::vec3 color)
+{
+    scene.addSphere(parent, model, scene.materials.intern(color, glm::vec3(0.5f), 32.0f));
+}
+
+
+// Build the restaurant's node hierarchy once, in the order the scene used to be drawn
+void buildScene(SceneGraph& scene)
+{
+    CpuTimer timer("buildScene");
+    // Restaurant floor and walls; like the wall decorations below they never
+    // move and are baked into the merged static geometry
+    int shellStart = scene.size();
+    drawRestaurant(scene);
+    drawWalls(scene);
+    scene.markMerged(shellStart, scene.size());
+
+    // Light source cubes
+    drawLightSource(scene, glm::vec3(4.0f, 5.0f, -4.0f), glm::vec3(1.0f, 0.5f, 1.0f)); // Pink light source
+    drawLightSource(scene, glm::vec3(-4.0f, 5.0f, -4.0f), glm::vec3(1.0f, 1.0f, 1.0f)); // White light source
+    drawLightSource(scene, glm::vec3(0.0f, 4.0f, 3.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+
+    // Pendant light in the dark area
+    drawPendantLight(scene, 0.0f, 3.0f);
+
+    // Each table owns its legs, its chairs and its table setting
+    for (glm::vec3 tablePos : tablePositions)
+        drawDiningTable(scene, tablePos);
+
+    int decorStart = scene.size();
+    drawWallArt(scene);
+    drawShelf(scene);
+    drawWindows(scene);
+    scene.markMerged(decorStart, scene.size());
+
+    drawCeilingFan(scene, 0.0f, 0.0f);
+}
+
+
+// Spread count items evenly over a width x depth area centered on the
+// origin, in a grid of roughly square cells; returns item i's (x, z)
+glm::vec2 spreadEvenly(int i, int count, float width, float depth)
+{
+    int columns = max(1, min(count, (int)lround(sqrt(count * width / depth))));
+    int rows = (count + columns - 1) / columns;
+    return glm::vec2(-0.5f * width + (i % columns + 0.5f) * width / columns,
+                     -0.5f * depth + (i / columns + 0.5f) * depth / rows);
+}
+
+
+// A food-court sized venue for scaling tests, furnished like the restaurant:
+// rows of dining tables in one large room, with pendant lights and ceiling
+// fans spread evenly under the ceiling
+void buildVenue(SceneGraph& scene, const VenueLayout& venue, vector<SceneLight>& venueLights)
+{
+    CpuTimer timer("buildVenue");
+    const float tableSpacing = 4.5f; // a table with its chairs is about 3.7 across
+    int rows = max(1, min(venue.rows, venue.tables));
+    int columns = max(1, (venue.tables + rows - 1) / rows);
+    float width = columns * tableSpacing + 2.0f;
+    float depth = rows * tableSpacing + 2.0f;
+
+    // Floor, side and back walls and the ceiling, like drawRestaurant and drawWalls
+    int shellStart = scene.size();
+    glm::vec3 wallColor = glm::vec3(0.9f, 0.9f, 0.9f);
+    drawCube(scene, SceneGraph::ROOT, glm::scale(glm::mat4(1.0f), glm::vec3(width, 0.1f, depth)), glm::vec3(0.6f, 0.6f, 0.6f));
+    glm::mat4 wallModel = glm::translate(glm::mat4(1.0f), glm::vec3(-0.5f * width, 2.5f, 0.0f));
+    drawCube(scene, SceneGraph::ROOT, glm::scale(wallModel, glm::vec3(0.1f, 5.0f, depth)), wallColor);
+    wallModel = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f * width, 2.5f, 0.0f));
+    drawCube(scene, SceneGraph::ROOT, glm::scale(wallModel, glm::vec3(0.1f, 5.0f, depth)), wallColor);
+    wallModel = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 2.5f, -0.5f * depth));
+    drawCube(scene, SceneGraph::ROOT, glm::scale(wallModel, glm::vec3(width, 5.0f, 0.1f)), wallColor);
+    wallModel = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 5.0f, 0.0f));
+    drawCube(scene, SceneGraph::ROOT, glm::scale(wallModel, glm::vec3(width, 0.1f, depth)), wallColor);
+    scene.markMerged(shellStart, scene.size());
+
+    for (int i = 0; i < venue.tables; ++i)
+    {
+        float x = -0.5f * width + 1.0f + (i % columns + 0.5f) * tableSpacing;
+        float z = -0.5f * depth + 1.0f + (i / columns + 0.5f) * tableSpacing;
+        drawDiningTable(scene, glm::vec3(x, 0.5f, z));
+    }
+
+    // The directional light stays; each point light hangs just below a
+    // pendant's bulb, cycling through the colors of the restaurant's lights
+    venueLights.clear();
+    SceneLight sun = {};
+    sun.type = SceneLight::DIRECTIONAL;
+    sun.vector = directionalLight.direction;
+    sun.ambient = directionalLight.ambient;
+    sun.diffuse = directionalLight.diffuse;
+    sun.specular = directionalLight.specular;
+    venueLights.push_back(sun);
+    const PointLight* palette[] = { &pointlight1, &pointlight2, &pointlight3 };
+    for (int i = 0; i < venue.lights; ++i)
+    {
+        glm::vec2 spot = spreadEvenly(i, venue.lights, width, depth);
+        drawPendantLight(scene, spot.x, spot.y);
+
+        const PointLight& look = *palette[i % 3];
+        SceneLight light = {};
+        light.type = SceneLight::POINT;
+        light.vector = glm::vec3(spot.x, 3.3f, spot.y);
+        light.ambient = 0.2f * look.ambient; // many lights overlap, so less ambient each
+        light.diffuse = look.diffuse;
+        light.specular = look.specular;
+        light.k_c = look.k_c;
+        light.k_l = look.k_l;
+        light.k_q = look.k_q;
+        venueLights.push_back(light);
+    }
+
+    for (int i = 0; i < venue.fans; ++i)
+    {
+        glm::vec2 spot = spreadEvenly(i, venue.fans, width, depth);
+        drawCeilingFan(scene, spot.x, spot.y);
     }
 }
 
 
+// Build the built-in scene or a generated venue, or load the scene from a
+// text or compiled scene file
+bool loadScene(SceneGraph& scene, SceneFile& file, const string& path, const VenueLayout* venue)
+{
+    if (path.empty() && venue)
+    {
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        vector<SceneLight> venueLights;
+        buildVenue(scene, *venue, venueLights);
+        applySceneLights(venueLights);
+        double buildMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+        cout << "Venue: " << venue->tables << " tables in " << max(1, min(venue->rows, venue->tables)) << " rows, "
+             << venue->lights << " lights, " << venue->fans << " fans: " << scene.size() << " nodes in " << buildMs << " ms" << endl;
+        return true;
+    }
+    if (path.empty())
+    {
+        buildScene(scene);
+        return true;
+    }
 
+    chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+    if (!file.load(path, scene))
+        return false;
+    double loadMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    applySceneLights(file.lights);
+    ceilingFanRotors = scene.findAll("ceilingFanRotor");
+    cout << "Scene: " << scene.size() << " nodes, " << scene.materials.size() << " materials, " << file.lights.size()
+         << " lights from " << path << (file.isMapped() ? " (mapped)" : "") << " in " << loadMs << " ms" << endl;
+    return true;
+}
 
-void drawCube(unsigned int& cubeVAO, Shader& lightingShader, glm::mat4 model, glm::vec3 color)
+
+// The current lights, as written to scene files
+vector<SceneLight> sceneLights()
 {
-    lightingShader.setVec3("material.ambient", color);
-    lightingShader.setVec3("material.diffuse", color);
-    lightingShader.setVec3("material.specular", glm::vec3(0.5f));
-    lightingShader.setFloat("material.shininess", 32.0f);
-    lightingShader.setMat4("model", model);
+    vector<SceneLight> result;
+    SceneLight sun = {};
+    sun.type = SceneLight::DIRECTIONAL;
+    sun.vector = directionalLight.direction;
+    sun.ambient = directionalLight.ambient;
+    sun.diffuse = directionalLight.diffuse;
+    sun.specular = directionalLight.specular;
+    result.push_back(sun);
+    for (const PointLight* light : scenePointLights)
+    {
+        SceneLight point = {};
+        point.type = SceneLight::POINT;
+        point.vector = light->position;
+        point.ambient = light->ambient;
+        point.diffuse = light->diffuse;
+        point.specular = light->specular;
+        point.k_c = light->k_c;
+        point.k_l = light->k_l;
+        point.k_q = light->k_q;
+        result.push_back(point);
+    }
+    return result;
+}
+
 
-    glBindVertexArray(cubeVAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+// Which terms a light adds: a term is compiled in if some light has a nonzero color for it
+unsigned int lightTerms(const glm::vec3& ambient, const glm::vec3& diffuse, const glm::vec3& specular)
+{
+    const glm::vec3 black(0.0f);
+    return (ambient != black ? PHONG_AMBIENT : 0) | (diffuse != black ? PHONG_DIFFUSE : 0) | (specular != black ? PHONG_SPECULAR : 0);
 }
 
 
-void drawRestaurant(unsigned int& cubeVAO, Shader& lightingShader)
+// Phong variant for the current light state. Switched-off lights and
+// components contribute exactly zero, so leaving them out changes nothing
+// on screen but their cost. Shadows are on unless --no-shadows.
+unsigned int phongVariantKey()
 {
+    unsigned int directionalTerms = lightTerms(directionalLight.effectiveAmbient(), directionalLight.effectiveDiffuse(), directionalLight.effectiveSpecular());
+    unsigned int pointTerms = 0;
+    for (const PointLight* light : scenePointLights)
+        pointTerms |= lightTerms(light->effectiveAmbient(), light->effectiveDiffuse(), light->effectiveSpecular());
+    return (directionalTerms ? PHONG_DIRECTIONAL_LIGHT : 0) | (pointTerms ? PHONG_POINT_LIGHTS : 0) | directionalTerms | pointTerms |
+           (shadowsEnabled ? PHONG_SHADOWS : 0);
+}
+
+
+// Replace the lights with those of a scene file. The first three point lights
+// reuse the global ones, the rest are allocated; the light keys reach them all
+// through scenePointLights.
+void applySceneLights(const vector<SceneLight>& fileLights)
+{
+    scenePointLights.clear();
+    extraPointLights.clear();
+    for (const SceneLight& light : fileLights)
+    {
+        if (light.type == SceneLight::DIRECTIONAL)
+        {
+            directionalLight.direction = light.vector;
+            directionalLight.setAmbient(light.ambient);
+            directionalLight.setDiffuse(light.diffuse);
+            directionalLight.setSpecular(light.specular);
+            continue;
+        }
+        PointLight* point;
+        PointLight* globals[] = { &pointlight1, &pointlight2, &pointlight3 };
+        if (scenePointLights.size() < 3)
+        {
+            point = globals[scenePointLights.size()];
+        }
+        else
+        {
+            extraPointLights.push_back(unique_ptr<PointLight>(new PointLight(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+                                                                             1.0f, 0.0f, 0.0f, static_cast<int>(scenePointLights.size()) + 1)));
+            point = extraPointLights.back().get();
+        }
+        point->position = light.vector;
+        point->ambient = light.ambient;
+        point->diffuse = light.diffuse;
+        point->specular = light.specular;
+        point->k_c = light.k_c;
+        point->k_l = light.k_l;
+        point->k_q = light.k_q;
+        point->markDirty();
+        scenePointLights.push_back(point);
+    }
+}
+
+
+void drawRestaurant(SceneGraph& scene)
+{
+    CpuTimer timer("drawRestaurant");
     glm::mat4 model = glm::mat4(1.0f);
 
     // Floor
     model = glm::scale(model, glm::vec3(10.0f, 0.1f, 10.0f));
-    drawCube(cubeVAO, lightingShader, model, glm::vec3(0.5f, 0.5f, 0.5f));
+    drawCube(scene, SceneGraph::ROOT, model, glm::vec3(0.5f, 0.5f, 0.5f));
 
     // Debug cube for visibility
     //glm::mat4 debugCube = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
     //debugCube = glm::scale(debugCube, glm::vec3(1.0f));
-    //drawCube(cubeVAO, lightingShader, debugCube, glm::vec3(1.0f, 0.0f, 0.0f)); // Red cube for debugging
-
-    drawCube(cubeVAO, lightingShader, glm::scale(glm::mat4(1.0f), glm::vec3(10.0f, 0.1f, 10.0f)), glm::vec3(0.6f, 0.6f, 0.6f));
-
+    //drawCube(scene, SceneGraph::ROOT, debugCube, glm::vec3(1.0f, 0.0f, 0.0f)); // Red cube for debugging
 }
 
 
-void drawCeilingFan(unsigned int& cubeVAO, Shader& lightingShader)
+// fan -> motor -> rotor -> blades; only the rotor's local transform changes
+void drawCeilingFan(SceneGraph& scene, float x, float z)
 {
+    CpuTimer timer("drawCeilingFan");
+    int fan = scene.addNode(SceneGraph::ROOT, glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, z)));
+
     // Draw the base of the ceiling fan
     glm::mat4 baseModel = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 4.8f, 0.0f));
     baseModel = glm::scale(baseModel, glm::vec3(0.2f, 0.6f, 0.2f)); // Adjust dimensions for the base rod
-    drawCube(cubeVAO, lightingShader, baseModel, glm::vec3(0.5f, 0.2f, 0.8f)); // Dark gray base
+    drawCube(scene, fan, baseModel, glm::vec3(0.5f, 0.2f, 0.8f)); // Dark gray base
 
     // Draw the motor housing of the ceiling fan
     glm::mat4 motorModel = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 4.5f, 0.0f));
     motorModel = glm::scale(motorModel, glm::vec3(0.5f, 0.2f, 0.5f)); // Circular-like motor casing
-    drawCube(cubeVAO, lightingShader, motorModel, glm::vec3(1.0f, 1.0f, 1.0f)); // Light gray motor casing
+    int motor = scene.addCube(fan, motorModel, scene.materials.intern(glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.5f), 32.0f)); // Light gray motor casing
 
-    // Update rotation angle if the fan is rotating
-    if (rotateCeilingFan)
-    {
-        ceilingFanRotationAngle += 700.0f * deltaTime; // Rotation speed
-        if (ceilingFanRotationAngle >= 360.0f) ceilingFanRotationAngle = 0.0f; // Keep angle within 360 degrees
-    }
+    // The rotor spins the blades, slightly below the motor
+    int rotor = scene.addNode(motor, ceilingFanRotorTransform());
+    scene.markDynamic(rotor);
+    scene.setName(rotor, "ceilingFanRotor");
+    ceilingFanRotors.push_back(rotor);
 
     // Draw the fan blades
     for (int i = 0; i < 4; ++i)
     {
-        glm::mat4 bladeModel = glm::translate(motorModel, glm::vec3(0.0f, -0.1f, 0.0f)); // Slightly below the motor
-        bladeModel = glm::rotate(bladeModel, glm::radians(ceilingFanRotationAngle + 90.0f * i), glm::vec3(0.0f, 1.0f, 0.0f)); // Rotate blades
+        glm::mat4 bladeModel = glm::rotate(glm::mat4(1.0f), glm::radians(90.0f * i), glm::vec3(0.0f, 1.0f, 0.0f)); // Spread blades evenly
         bladeModel = glm::translate(bladeModel, glm::vec3(0.0f, 0.0f, 1.0f)); // Extend outward
         bladeModel = glm::scale(bladeModel, glm::vec3(0.5f, 0.2f, 5.0f)); // Thin and long blades
-        drawCube(cubeVAO, lightingShader, bladeModel, glm::vec3(0.8f, 0.2f, 0.2f)); // Red blades
+        drawCube(scene, rotor, bladeModel, glm::vec3(0.8f, 0.2f, 0.2f)); // Red blades
+    }
+}
+
+
+glm::mat4 ceilingFanRotorTransform()
+{
+    glm::mat4 rotorModel = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.1f, 0.0f));
+    return glm::rotate(rotorModel, glm::radians(ceilingFanRotationAngle), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+
+// the simulation turns the fan; only redraw the rotors when the angle moved
+void updateCeilingFan(SceneGraph& scene, float angle)
+{
+    if (angle != ceilingFanRotationAngle)
+    {
+        ceilingFanRotationAngle = angle;
+        for (int rotor : ceilingFanRotors)
+            scene.setLocal(rotor, ceilingFanRotorTransform());
     }
 }
 
 
-void drawTable(unsigned int& cubeVAO, Shader& lightingShader, glm::vec3 position)
+int drawTable(SceneGraph& scene, glm::vec3 position)
 {
+    CpuTimer timer("drawTable");
+    int table = scene.addNode(SceneGraph::ROOT, glm::translate(glm::mat4(1.0f), position));
+
     // Draw the tabletop
-    glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
-    model = glm::scale(model, glm::vec3(2.0f, 0.1f, 2.0f)); // Thin tabletop
-    drawCube(cubeVAO, lightingShader, model, glm::vec3(0.6f, 0.3f, 0.1f)); // Wood-like color
+    glm::mat4 model = glm::scale(glm::mat4(1.0f), glm::vec3(2.0f, 0.1f, 2.0f)); // Thin tabletop
+    drawCube(scene, table, model, glm::vec3(0.6f, 0.3f, 0.1f)); // Wood-like color
 
     // Adjust leg offsets relative to the tabletop size
     glm::vec3 legOffsets[] = {
@@ -512,21 +1209,43 @@ void drawTable(unsigned int& cubeVAO, Shader& lightingShader, glm::vec3 position
     // Correct leg positioning based on tabletop scaling
     for (int i = 0; i < 4; ++i)
     {
-        glm::mat4 legModel = glm::translate(glm::mat4(1.0f), position + glm::vec3(legOffsets[i].x * 2.0f, -0.28f, legOffsets[i].z * 2.0f));
+        glm::mat4 legModel = glm::translate(glm::mat4(1.0f), glm::vec3(legOffsets[i].x * 2.0f, -0.28f, legOffsets[i].z * 2.0f));
         legModel = glm::scale(legModel, legScale); // Scale the legs
-        drawCube(cubeVAO, lightingShader, legModel, glm::vec3(0.5f, 0.2f, 0.1f)); // Leg color
+        drawCube(scene, table, legModel, glm::vec3(0.5f, 0.2f, 0.1f)); // Leg color
     }
+    return table;
 }
 
 
-void drawChair(unsigned int& cubeVAO, Shader& lightingShader, glm::vec3 position, float rotationAngle)
+// a table with four chairs around it and a table setting on top
+void drawDiningTable(SceneGraph& scene, glm::vec3 position)
 {
+    int table = drawTable(scene, position);
+
+    float chairDistance = 1.6f;
+
+    // Chairs with backrests positioned at the rear edge
+    drawChair(scene, table, glm::vec3(chairDistance, 0.0f, 0.0f), -90.0f); // Right chair facing center
+    drawChair(scene, table, glm::vec3(-chairDistance, 0.0f, 0.0f), 90.0f); // Left chair facing center
+    drawChair(scene, table, glm::vec3(0.0f, 0.0f, chairDistance), 180.0f); // Back chair facing center
+    drawChair(scene, table, glm::vec3(0.0f, 0.0f, -chairDistance), 0.0f);  // Front chair facing center
+
+    drawTableSettings(scene, table);
+}
+
+
+// position is relative to the parent (the table the chair belongs to)
+void drawChair(SceneGraph& scene, int parent, glm::vec3 position, float rotationAngle)
+{
+    CpuTimer timer("drawChair");
+    glm::mat4 chairModel = glm::translate(glm::mat4(1.0f), position);
+    chairModel = glm::rotate(chairModel, glm::radians(rotationAngle), glm::vec3(0.0f, 1.0f, 0.0f)); // Apply rotation
+    int chair = scene.addNode(parent, chairModel);
+
     // Chair seat
-    glm::mat4 seatModel = glm::translate(glm::mat4(1.0f), position);
-    seatModel = glm::rotate(seatModel, glm::radians(rotationAngle), glm::vec3(0.0f, 1.0f, 0.0f)); // Apply rotation
-    seatModel = glm::translate(seatModel, glm::vec3(0.0f, -0.15f, 0.0f)); // Adjust position after rotation
+    glm::mat4 seatModel = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.15f, 0.0f)); // Adjust position after rotation
     seatModel = glm::scale(seatModel, glm::vec3(0.5f, 0.1f, 0.5f)); // Dimensions of the seat
-    drawCube(cubeVAO, lightingShader, seatModel, glm::vec3(0.4f, 0.2f, 0.1f)); // Brown seat
+    drawCube(scene, chair, seatModel, glm::vec3(0.4f, 0.2f, 0.1f)); // Brown seat
 
     // Chair legs
     glm::vec3 legOffsets[] = {
@@ -538,19 +1257,15 @@ void drawChair(unsigned int& cubeVAO, Shader& lightingShader, glm::vec3 position
 
     for (int i = 0; i < 4; ++i)
     {
-        glm::mat4 legModel = glm::translate(glm::mat4(1.0f), position);
-        legModel = glm::rotate(legModel, glm::radians(rotationAngle), glm::vec3(0.0f, 1.0f, 0.0f)); // Apply rotation
-        legModel = glm::translate(legModel, legOffsets[i]);
+        glm::mat4 legModel = glm::translate(glm::mat4(1.0f), legOffsets[i]);
         legModel = glm::scale(legModel, glm::vec3(0.05f, 0.25f, 0.05f)); // Legs' dimensions
-        drawCube(cubeVAO, lightingShader, legModel, glm::vec3(0.4f, 0.2f, 0.1f)); // Brown legs
+        drawCube(scene, chair, legModel, glm::vec3(0.4f, 0.2f, 0.1f)); // Brown legs
     }
 
     // Chair backrest (Positioned at the edge of the seat)
-    glm::mat4 backrestModel = glm::translate(glm::mat4(1.0f), position);
-    backrestModel = glm::rotate(backrestModel, glm::radians(rotationAngle), glm::vec3(0.0f, 1.0f, 0.0f)); // Apply rotation
-    backrestModel = glm::translate(backrestModel, glm::vec3(0.0f, 0.2f, -0.25f - 0.05f)); // Move backrest to edge
+    glm::mat4 backrestModel = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.2f, -0.25f - 0.05f)); // Move backrest to edge
     backrestModel = glm::scale(backrestModel, glm::vec3(0.5f, 0.6f, 0.1f)); // Taller and thinner backrest
-    drawCube(cubeVAO, lightingShader, backrestModel, glm::vec3(0.4f, 0.2f, 0.1f)); // Brown backrest
+    drawCube(scene, chair, backrestModel, glm::vec3(0.4f, 0.2f, 0.1f)); // Brown backrest
 }
 
 
@@ -559,54 +1274,44 @@ void drawChair(unsigned int& cubeVAO, Shader& lightingShader, glm::vec3 position
 
 
 
-void drawLightSource(unsigned int& cubeVAO, Shader& lightingShader, glm::vec3 position, glm::vec3 color)
+void drawLightSource(SceneGraph& scene, glm::vec3 position, glm::vec3 color)
 {
+    CpuTimer timer("drawLightSource");
     glm::mat4 model = glm::translate(glm::mat4(1.0f), position); // Place the light source
     model = glm::scale(model, glm::vec3(0.3f)); // Adjust the size of the light cube
-    lightingShader.setMat4("model", model);
-
-    // Set cube color to match the light source
-    lightingShader.setVec3("material.ambient", color); // Ambient color
-    lightingShader.setVec3("material.diffuse", color); // Diffuse color
-    lightingShader.setVec3("material.specular", glm::vec3(1.0f)); // Specular highlight
-    lightingShader.setFloat("material.shininess", 32.0f); // Shininess
 
-    glBindVertexArray(cubeVAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    // Cube color matches the light source, with a full specular highlight
+    scene.addCube(SceneGraph::ROOT, model, scene.materials.intern(color, glm::vec3(1.0f), 32.0f));
 }
 
 
-void drawWalls(unsigned int& cubeVAO, Shader& lightingShader)
+void drawWalls(SceneGraph& scene)
 {
+    CpuTimer timer("drawWalls");
     glm::mat4 wallModel;
 
     // Set wall material properties
     glm::vec3 wallColor = glm::vec3(0.9f, 0.9f, 0.9f); // Off-white color
-    glm::vec3 specular = glm::vec3(0.1f); // Reduced specular reflection
-    float shininess = 16.0f; // Reduced shininess
-
-    lightingShader.setVec3("material.specular", specular);
-    lightingShader.setFloat("material.shininess", shininess);
 
     // Left Wall
     wallModel = glm::translate(glm::mat4(1.0f), glm::vec3(-5.0f, 2.5f, 0.0f));
     wallModel = glm::scale(wallModel, glm::vec3(0.1f, 5.0f, 10.0f));
-    drawCube(cubeVAO, lightingShader, wallModel, wallColor);
+    drawCube(scene, SceneGraph::ROOT, wallModel, wallColor);
 
     // Right Wall
     wallModel = glm::translate(glm::mat4(1.0f), glm::vec3(5.0f, 2.5f, 0.0f));
     wallModel = glm::scale(wallModel, glm::vec3(0.1f, 5.0f, 10.0f));
-    drawCube(cubeVAO, lightingShader, wallModel, wallColor);
+    drawCube(scene, SceneGraph::ROOT, wallModel, wallColor);
 
     // Back Wall
     wallModel = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 2.5f, -5.0f));
     wallModel = glm::scale(wallModel, glm::vec3(10.0f, 5.0f, 0.1f));
-    drawCube(cubeVAO, lightingShader, wallModel, wallColor);
+    drawCube(scene, SceneGraph::ROOT, wallModel, wallColor);
 
     // Ceiling
     wallModel = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 5.0f, 0.0f));
     wallModel = glm::scale(wallModel, glm::vec3(10.0f, 0.1f, 10.0f));
-    drawCube(cubeVAO, lightingShader, wallModel, wallColor);
+    drawCube(scene, SceneGraph::ROOT, wallModel, wallColor);
 }
 
 
@@ -615,75 +1320,82 @@ void drawWalls(unsigned int& cubeVAO, Shader& lightingShader)
 
 
 
-void drawWallArt(unsigned int& cubeVAO, Shader& lightingShader)
+void drawWallArt(SceneGraph& scene)
 {
+    CpuTimer timer("drawWallArt");
     glm::mat4 model;
 
     // Wall Art (painting on the left wall)
     model = glm::translate(glm::mat4(1.0f), glm::vec3(-4.9f, 2.5f, -2.0f)); // Slightly away from the left wall
     model = glm::scale(model, glm::vec3(0.1f, 1.5f, 2.0f)); // Thin rectangular art piece
-    drawCube(cubeVAO, lightingShader, model, glm::vec3(0.7f, 0.2f, 0.2f)); // Dark red color for the painting
+    drawCube(scene, SceneGraph::ROOT, model, glm::vec3(0.7f, 0.2f, 0.2f)); // Dark red color for the painting
 }
 
 
-void drawShelf(unsigned int& cubeVAO, Shader& lightingShader)
+void drawShelf(SceneGraph& scene)
 {
+    CpuTimer timer("drawShelf");
     glm::mat4 model;
 
     // Shelf (on the left wall)
     model = glm::translate(glm::mat4(1.0f), glm::vec3(-4.9f, 1.5f, 1.0f)); // Positioned at mid-height
     model = glm::scale(model, glm::vec3(0.1f, 0.2f, 2.0f)); // Thin horizontal shelf
-    drawCube(cubeVAO, lightingShader, model, glm::vec3(0.4f, 0.2f, 0.1f)); // Wood color for the shelf
+    drawCube(scene, SceneGraph::ROOT, model, glm::vec3(0.4f, 0.2f, 0.1f)); // Wood color for the shelf
 
     // Decorative Item (book)
     model = glm::translate(glm::mat4(1.0f), glm::vec3(-4.7f, 1.6f, 1.0f)); // On the shelf
     model = glm::scale(model, glm::vec3(0.1f, 0.4f, 0.2f)); // Thin book-like object
-    drawCube(cubeVAO, lightingShader, model, glm::vec3(0.1f, 0.1f, 0.8f)); // Blue color for the book
+    drawCube(scene, SceneGraph::ROOT, model, glm::vec3(0.1f, 0.1f, 0.8f)); // Blue color for the book
 }
 
 
 
-void drawTableSettings(unsigned int& cubeVAO, Shader& lightingShader, glm::vec3 tablePosition)
+// placed relative to the table node
+void drawTableSettings(SceneGraph& scene, int table)
 {
+    CpuTimer timer("drawTableSettings");
     glm::mat4 model;
 
     // Plate (Touching the table surface)
-    model = glm::translate(glm::mat4(1.0f), tablePosition + glm::vec3(0.3f, 0.05f, 0.3f)); // Adjusted height to be on the table surface
+    model = glm::translate(glm::mat4(1.0f), glm::vec3(0.3f, 0.05f, 0.3f)); // Adjusted height to be on the table surface
     model = glm::scale(model, glm::vec3(0.3f, 0.02f, 0.3f)); // Flat circular-like object
-    drawCube(cubeVAO, lightingShader, model, glm::vec3(0.9f, 0.9f, 0.9f)); // White color for the plate
+    drawSphere(scene, table, model, glm::vec3(0.9f, 0.9f, 0.9f)); // White color for the plate
 
     // Glass (Touching the table surface)
-    model = glm::translate(glm::mat4(1.0f), tablePosition + glm::vec3(-0.3f, 0.1f, 0.3f)); // Adjusted height to place the base of the glass on the table
+    model = glm::translate(glm::mat4(1.0f), glm::vec3(-0.3f, 0.1f, 0.3f)); // Adjusted height to place the base of the glass on the table
     model = glm::scale(model, glm::vec3(0.1f, 0.2f, 0.1f)); // Cylindrical glass-like object
-    drawCube(cubeVAO, lightingShader, model, glm::vec3(0.8f, 0.8f, 1.0f)); // Slightly transparent blue glass
+    drawSphere(scene, table, model, glm::vec3(0.8f, 0.8f, 1.0f)); // Slightly transparent blue glass
 
     // Napkin (Touching the table surface)
-    model = glm::translate(glm::mat4(1.0f), tablePosition + glm::vec3(0.0f, 0.05f, -0.3f)); // Adjusted height to lie flat on the table
+    model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.05f, -0.3f)); // Adjusted height to lie flat on the table
     model = glm::scale(model, glm::vec3(0.2f, 0.01f, 0.2f)); // Thin flat square
-    drawCube(cubeVAO, lightingShader, model, glm::vec3(1.0f, 1.0f, 1.0f)); // White napkin
+    drawCube(scene, table, model, glm::vec3(1.0f, 1.0f, 1.0f)); // White napkin
 }
 
 
 
 
-void drawPendantLight(unsigned int& cubeVAO, Shader& lightingShader)
+
+// hangs from the ceiling above floor position (x, z)
+void drawPendantLight(SceneGraph& scene, float x, float z)
 {
+    CpuTimer timer("drawPendantLight");
     glm::mat4 model;
 
     // Decorative Pendant Light Base
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 4.0f, 3.0f)); // Positioned in the front dark area
+    model = glm::translate(glm::mat4(1.0f), glm::vec3(x, 4.0f, z)); // Positioned in the front dark area
     model = glm::scale(model, glm::vec3(0.4f, 0.6f, 0.4f)); // Slightly larger and rounded
-    drawCube(cubeVAO, lightingShader, model, glm::vec3(0.2f, 0.2f, 0.8f)); // Dark blue metallic structure
+    drawCube(scene, SceneGraph::ROOT, model, glm::vec3(0.2f, 0.2f, 0.8f)); // Dark blue metallic structure
 
     // Glowing Glass Bulb
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 3.7f, 3.0f)); // Positioned slightly below the base
+    model = glm::translate(glm::mat4(1.0f), glm::vec3(x, 3.7f, z)); // Positioned slightly below the base
     model = glm::scale(model, glm::vec3(0.3f, 0.4f, 0.3f)); // Bulb size
-    drawCube(cubeVAO, lightingShader, model, glm::vec3(0.3f, 0.7f, 1.0f)); // Bright translucent light blue for the bulb
+    drawSphere(scene, SceneGraph::ROOT, model, glm::vec3(0.3f, 0.7f, 1.0f)); // Bright translucent light blue for the bulb
 
     // Add a ring detail at the bottom of the base
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 4.2f, 3.0f)); // At the bottom of the base
+    model = glm::translate(glm::mat4(1.0f), glm::vec3(x, 4.2f, z)); // At the bottom of the base
     model = glm::scale(model, glm::vec3(0.5f, 0.05f, 0.5f)); // Thin decorative ring
-    drawCube(cubeVAO, lightingShader, model, glm::vec3(0.4f, 0.4f, 1.0f)); // Slightly lighter blue for contrast
+    drawCube(scene, SceneGraph::ROOT, model, glm::vec3(0.4f, 0.4f, 1.0f)); // Slightly lighter blue for contrast
 
     // Chandelier-style chain (alternating spheres and cylinders)
     glm::vec3 chainColor = glm::vec3(0.8f, 0.6f, 0.3f); // Gold chain color
@@ -694,50 +1406,51 @@ void drawPendantLight(unsigned int& cubeVAO, Shader& lightingShader)
     for (float offset = 0.0f; offset <= (chainStartHeight - chainEndHeight); offset += linkSpacing)
     {
         // Sphere (decorative chain links)
-        model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, chainStartHeight - offset, 3.0f));
+        model = glm::translate(glm::mat4(1.0f), glm::vec3(x, chainStartHeight - offset, z));
         model = glm::scale(model, glm::vec3(0.08f)); // Small sphere for the chain
-        drawCube(cubeVAO, lightingShader, model, chainColor);
+        drawSphere(scene, SceneGraph::ROOT, model, chainColor);
 
         // Cylinder (connecting parts of the chain)
         if (offset + linkSpacing < (chainStartHeight - chainEndHeight))
         {
-            model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, chainStartHeight - offset - linkSpacing / 2.0f, 3.0f));
+            model = glm::translate(glm::mat4(1.0f), glm::vec3(x, chainStartHeight - offset - linkSpacing / 2.0f, z));
             model = glm::scale(model, glm::vec3(0.05f, linkSpacing / 2.0f, 0.05f)); // Thin cylinder connecting links
-            drawCube(cubeVAO, lightingShader, model, chainColor);
+            drawCube(scene, SceneGraph::ROOT, model, chainColor);
         }
     }
 
     // Ceiling Plate (where the chain attaches)
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, chainStartHeight + 0.05f, 3.0f)); // Slightly above the chain
+    model = glm::translate(glm::mat4(1.0f), glm::vec3(x, chainStartHeight + 0.05f, z)); // Slightly above the chain
     model = glm::scale(model, glm::vec3(0.3f, 0.05f, 0.3f)); // Thin plate
-    drawCube(cubeVAO, lightingShader, model, glm::vec3(0.6f, 0.6f, 0.6f)); // Neutral gray for the plate
+    drawCube(scene, SceneGraph::ROOT, model, glm::vec3(0.6f, 0.6f, 0.6f)); // Neutral gray for the plate
 
     // Emit Light Source Visualization (The actual light glow)
     glm::vec3 lightColor = glm::vec3(0.0f, 0.5f, 1.0f); // Vibrant blue light color
-    drawLightSource(cubeVAO, lightingShader, glm::vec3(0.0f, 3.7f, 3.0f), lightColor); // Positioned at the bulb
+    drawLightSource(scene, glm::vec3(x, 3.7f, z), lightColor); // Positioned at the bulb
 }
 
 
 
 
-void drawWindows(unsigned int& cubeVAO, Shader& lightingShader)
+void drawWindows(SceneGraph& scene)
 {
+    CpuTimer timer("drawWindows");
     glm::mat4 model;
 
     // Window frame on the right wall
     model = glm::translate(glm::mat4(1.0f), glm::vec3(4.9f, 3.0f, 0.0f)); // Centered on the right wall
     model = glm::scale(model, glm::vec3(0.1f, 1.5f, 2.0f)); // Thin vertical window
-    drawCube(cubeVAO, lightingShader, model, glm::vec3(0.8f, 0.8f, 1.0f)); // Light blue for the glass
+    drawCube(scene, SceneGraph::ROOT, model, glm::vec3(0.8f, 0.8f, 1.0f)); // Light blue for the glass
 
     // Left Curtain
     model = glm::translate(glm::mat4(1.0f), glm::vec3(4.8f, 3.0f, -1.0f)); // Left side of the window
     model = glm::scale(model, glm::vec3(0.1f, 1.5f, 0.5f)); // Thin vertical rectangle
-    drawCube(cubeVAO, lightingShader, model, glm::vec3(0.7f, 0.3f, 0.3f)); // Red curtain
+    drawCube(scene, SceneGraph::ROOT, model, glm::vec3(0.7f, 0.3f, 0.3f)); // Red curtain
 
     // Right Curtain
     model = glm::translate(glm::mat4(1.0f), glm::vec3(4.8f, 3.0f, 1.0f)); // Right side of the window
     model = glm::scale(model, glm::vec3(0.1f, 1.5f, 0.5f)); // Thin vertical rectangle
-    drawCube(cubeVAO, lightingShader, model, glm::vec3(0.7f, 0.3f, 0.3f)); // Red curtain
+    drawCube(scene, SceneGraph::ROOT, model, glm::vec3(0.7f, 0.3f, 0.3f)); // Red curtain
 }
 
 
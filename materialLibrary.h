@@ -0,0 +1,131 @@
+#ifndef MATERIAL_LIBRARY_H
+#define MATERIAL_LIBRARY_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Phong material, as used by fragmentShaderForPhongShading.fs
+struct Material
+{
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+    float shininess;
+
+    bool operator==(const Material& other) const
+    {
+        return ambient == other.ambient && diffuse == other.diffuse && specular == other.specular && shininess == other.shininess;
+    }
+};
+
+// One material as three RGBA32F texels of the materialData buffer texture
+struct MaterialTexels
+{
+    glm::vec4 ambientShininess; // rgb = ambient, w = shininess
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+};
+
+// Every distinct material of the scene, interned so that equal materials
+// share one id. The whole table is kept in a single buffer texture and draws
+// only pass a material index, so no material uniforms are set per draw.
+// The GL objects are created on the first upload() and freed by release(),
+// which must run while the context is still current.
+class MaterialLibrary
+{
+public:
+    static const GLuint TEXTURE_UNIT = 3; // texture unit of materialData
+
+    MaterialLibrary() {}
+
+    ~MaterialLibrary()
+    {
+        release();
+    }
+
+    MaterialLibrary(const MaterialLibrary&) = delete;
+    MaterialLibrary& operator=(const MaterialLibrary&) = delete;
+
+    // id of the material, adding it if it is new
+    unsigned int intern(const Material& material)
+    {
+        for (size_t id = 0; id < materials.size(); ++id)
+            if (materials[id] == material)
+                return static_cast<unsigned int>(id);
+        materials.push_back(material);
+        dirty = true;
+        return static_cast<unsigned int>(materials.size() - 1);
+    }
+
+    // the usual cube material: ambient and diffuse share one color
+    unsigned int intern(const glm::vec3& color, const glm::vec3& specular, float shininess)
+    {
+        Material material = { color, color, specular, shininess };
+        return intern(material);
+    }
+
+    const Material& operator[](unsigned int id) const
+    {
+        return materials[id];
+    }
+
+    size_t size() const
+    {
+        return materials.size();
+    }
+
+    // delete the GL objects; a later upload() creates them again
+    void release()
+    {
+        if (texture)
+        {
+            glDeleteTextures(1, &texture);
+            glDeleteBuffers(1, &TBO);
+            texture = 0;
+            TBO = 0;
+        }
+    }
+
+    // copy the table to the GPU if materials were added since the last call
+    void upload()
+    {
+        if (!texture)
+        {
+            glGenBuffers(1, &TBO);
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_BUFFER, texture);
+            glBindBuffer(GL_TEXTURE_BUFFER, TBO);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, TBO);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+            dirty = true;
+        }
+        if (!dirty)
+            return;
+
+        std::vector<MaterialTexels> packed(materials.empty() ? 1 : materials.size(), MaterialTexels());
+        for (size_t id = 0; id < materials.size(); ++id)
+        {
+            packed[id].ambientShininess = glm::vec4(materials[id].ambient, materials[id].shininess);
+            packed[id].diffuse = glm::vec4(materials[id].diffuse, 0.0f);
+            packed[id].specular = glm::vec4(materials[id].specular, 0.0f);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, TBO);
+        glBufferData(GL_TEXTURE_BUFFER, packed.size() * sizeof(MaterialTexels), packed.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        dirty = false;
+    }
+
+    void bindTexture() const
+    {
+        glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+    }
+
+private:
+    std::vector<Material> materials;
+    unsigned int TBO = 0, texture = 0;
+    bool dirty = true;
+};
+
+#endif
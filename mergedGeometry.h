@@ -0,0 +1,278 @@
+#ifndef MERGED_GEOMETRY_H
+#define MERGED_GEOMETRY_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "meshBuffer.h"
+#include "instancedRenderer.h"
+#include "lightBaker.h"
+#include "normalMatrix.h"
+#include "sceneGraph.h"
+
+// The static shell of the restaurant (nodes flagged SceneGraph::MERGED) baked
+// into one vertex/index buffer. Every cube is transformed to world space on
+// the CPU and each vertex carries its material id, so the whole shell needs
+// no per-object state at all. The visible pieces are drawn with a single
+// glMultiDrawElements call in which neighbouring pieces collapse into one
+// range. The buffer is only rebuilt when the static layout of the scene
+// changes.
+// With a bake cell size, every face is tessellated into cells about that
+// large and the ambient and diffuse light of the fixed lights is baked into a
+// color per vertex (location 10, see LightBaker); normals are interpolated
+// across the cells exactly as the rasterizer would across the whole face.
+class MergedGeometry
+{
+public:
+    static const GLuint BAKED_LIGHT_LOCATION = 10;
+
+    MergedGeometry(const std::vector<float>& cubeVertices, const std::vector<unsigned int>& cubeIndices, bool allowPacked = true, float bakeCell = 0.0f)
+        : cubeVertices(cubeVertices), cubeIndices(cubeIndices), allowPacked(allowPacked), bakeCell(bakeCell)
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &instanceVBO);
+
+        // one identity instance, so the instanced shader draws the
+        // world-space vertices unchanged and takes the per-vertex material
+        InstanceData identity = InstancedRenderer::makeInstance(glm::mat4(1.0f), 0);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceData), &identity, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    ~MergedGeometry()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &instanceVBO);
+        if (bakedVBO)
+            glDeleteBuffers(1, &bakedVBO);
+    }
+
+    MergedGeometry(const MergedGeometry&) = delete;
+    MergedGeometry& operator=(const MergedGeometry&) = delete;
+
+    // rebuild the buffer if the scene's static layout changed since the last
+    // call; call after SceneGraph::updateWorld(). Returns true if it rebuilt.
+    bool update(const SceneGraph& scene)
+    {
+        if (built && builtVersion == scene.staticLayoutVersion())
+            return false;
+        build(scene);
+        builtVersion = scene.staticLayoutVersion();
+        built = true;
+        bakedOnce = false;
+        return true;
+    }
+
+    // whether the geometry carries baked lighting
+    bool isBaked() const
+    {
+        return bakeCell > 0.0f;
+    }
+
+    // re-bake the vertex lighting if the lights or the geometry changed since
+    // the last bake; call after update(). Returns true if it baked.
+    bool bakeLighting(const MaterialLibrary& materials, const DirectionalLight& directional, const std::vector<PointLight*>& pointLights, JobSystem& jobs,
+                      const LightBaker::Shadowed& shadowed = LightBaker::Shadowed())
+    {
+        if (!isBaked() || !built)
+            return false;
+        uint64_t state = LightBaker::state(directional, pointLights, shadowed);
+        if (bakedOnce && state == bakedState)
+            return false;
+        LightBaker::bake(bakeVertices, materials, directional, pointLights, jobs, bakedColors, shadowed);
+        glBindBuffer(GL_ARRAY_BUFFER, bakedVBO);
+        glBufferData(GL_ARRAY_BUFFER, bakedColors.size() * sizeof(glm::vec3), bakedColors.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        bakedState = state;
+        bakedOnce = true;
+        return true;
+    }
+
+    size_t vertexCount() const
+    {
+        return mesh.vertexCount;
+    }
+
+    // draw the given merged nodes, in any order; the shader must be bound
+    void draw(std::vector<int>& nodes)
+    {
+        counts.clear();
+        offsets.clear();
+        std::sort(nodes.begin(), nodes.end());
+        GLsizei rangeEnd = -1;
+        for (int node : nodes)
+        {
+            GLsizei first = firstIndex[node];
+            if (first < 0)
+                continue;
+            if (first == rangeEnd)
+            {
+                counts.back() += indexCount[node];
+            }
+            else
+            {
+                counts.push_back(indexCount[node]);
+                offsets.push_back(mesh.indexOffset(first));
+            }
+            rangeEnd = first + indexCount[node];
+        }
+        if (counts.empty())
+            return;
+
+        glBindVertexArray(VAO);
+        glMultiDrawElements(GL_TRIANGLES, counts.data(), mesh.indexType, offsets.data(), static_cast<GLsizei>(counts.size()));
+        glBindVertexArray(0);
+    }
+
+    // number of index ranges the last draw() was submitted as
+    size_t lastRangeCount() const
+    {
+        return counts.size();
+    }
+
+    const MeshBuffer& buffer() const
+    {
+        return mesh;
+    }
+
+private:
+    std::vector<float> cubeVertices;
+    std::vector<unsigned int> cubeIndices;
+    bool allowPacked;
+    float bakeCell;
+    unsigned int VAO = 0, instanceVBO = 0, bakedVBO = 0;
+    MeshBuffer mesh;
+    std::vector<GLsizei> firstIndex; // per scene node, -1 unless merged
+    std::vector<GLsizei> indexCount; // per scene node
+    std::vector<LightBaker::Vertex> bakeVertices;
+    std::vector<glm::vec3> bakedColors;
+    uint64_t bakedState = 0;
+    bool bakedOnce = false;
+    bool built = false;
+    unsigned int builtVersion = 0;
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+
+    void build(const SceneGraph& scene)
+    {
+        std::vector<float> vertices;
+        std::vector<unsigned int> indices;
+        std::vector<unsigned int> materials;
+        size_t cubeVertexCount = cubeVertices.size() / 6;
+        firstIndex.assign(scene.size(), -1);
+        indexCount.assign(scene.size(), 0);
+        bakeVertices.clear();
+
+        for (int node = 0; node < scene.size(); ++node)
+        {
+            if (!(scene.flags[node] & SceneGraph::MERGED))
+                continue;
+            const glm::mat4& world = scene.world[node];
+            glm::mat3 normalMatrix = computeNormalMatrix(world);
+            if (isBaked())
+            {
+                firstIndex[node] = static_cast<GLsizei>(indices.size());
+                for (size_t face = 0; face + 6 <= cubeIndices.size(); face += 6)
+                    tessellateFace(&cubeIndices[face], world, normalMatrix, scene.material[node], vertices, indices, materials);
+                indexCount[node] = static_cast<GLsizei>(indices.size()) - firstIndex[node];
+                continue;
+            }
+            unsigned int base = static_cast<unsigned int>(vertices.size() / 6);
+            for (size_t v = 0; v < cubeVertexCount; ++v)
+            {
+                const float* source = &cubeVertices[6 * v];
+                glm::vec3 position(world * glm::vec4(source[0], source[1], source[2], 1.0f));
+                glm::vec3 normal = glm::normalize(normalMatrix * glm::vec3(source[3], source[4], source[5]));
+                vertices.insert(vertices.end(), { position.x, position.y, position.z, normal.x, normal.y, normal.z });
+                materials.push_back(scene.material[node]);
+            }
+            firstIndex[node] = static_cast<GLsizei>(indices.size());
+            indexCount[node] = static_cast<GLsizei>(cubeIndices.size());
+            for (unsigned int index : cubeIndices)
+                indices.push_back(base + index);
+        }
+
+        mesh.upload(vertices, indices, allowPacked, &materials);
+
+        // the layout may have changed with the new contents
+        glBindVertexArray(VAO);
+        mesh.bindAttributes();
+        InstancedRenderer::bindInstanceAttributes(instanceVBO, false);
+        if (isBaked())
+        {
+            if (!bakedVBO)
+                glGenBuffers(1, &bakedVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, bakedVBO);
+            glVertexAttribPointer(BAKED_LIGHT_LOCATION, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+            glEnableVertexAttribArray(BAKED_LIGHT_LOCATION);
+        }
+        glBindVertexArray(0);
+    }
+
+    // split the quad of two triangles (a, b, c) (c, d, a) into a grid of
+    // cells no larger than bakeCell, interpolating positions and normals
+    // bilinearly; both are linear across a cube face, so this changes nothing
+    // about how the face is shaded
+    void tessellateFace(const unsigned int* face, const glm::mat4& world, const glm::mat3& normalMatrix, unsigned int material,
+                        std::vector<float>& vertices, std::vector<unsigned int>& indices, std::vector<unsigned int>& materials)
+    {
+        if (face[3] != face[2] || face[5] != face[0])
+            return; // not a quad
+        glm::vec3 corners[4], normals[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            const float* source = &cubeVertices[6 * face[i < 3 ? i : 4]];
+            corners[i] = glm::vec3(world * glm::vec4(source[0], source[1], source[2], 1.0f));
+            normals[i] = normalMatrix * glm::vec3(source[3], source[4], source[5]);
+        }
+        // the untessellated mesh normalizes each corner; all of a cube's
+        // corner normals transform to the same length, so one scale keeps
+        // the interpolated normals proportional to the original ones
+        float scale = glm::length(normals[0]) > 0.0f ? 1.0f / glm::length(normals[0]) : 1.0f;
+        int columns = cellCount(glm::length(corners[1] - corners[0]));
+        int rows = cellCount(glm::length(corners[3] - corners[0]));
+
+        unsigned int base = static_cast<unsigned int>(vertices.size() / 6);
+        for (int row = 0; row <= rows; ++row)
+        {
+            float v = static_cast<float>(row) / rows;
+            for (int column = 0; column <= columns; ++column)
+            {
+                float u = static_cast<float>(column) / columns;
+                float weights[4] = { (1 - u) * (1 - v), u * (1 - v), u * v, (1 - u) * v };
+                LightBaker::Vertex vertex = { glm::vec3(0.0f), glm::vec3(0.0f), material };
+                for (int i = 0; i < 4; ++i)
+                {
+                    vertex.position += weights[i] * corners[i];
+                    vertex.normal += weights[i] * scale * normals[i];
+                }
+                vertices.insert(vertices.end(), { vertex.position.x, vertex.position.y, vertex.position.z, vertex.normal.x, vertex.normal.y, vertex.normal.z });
+                materials.push_back(material);
+                bakeVertices.push_back(vertex);
+            }
+        }
+        for (int row = 0; row < rows; ++row)
+        {
+            for (int column = 0; column < columns; ++column)
+            {
+                unsigned int a = base + row * (columns + 1) + column;
+                unsigned int b = a + 1, d = a + columns + 1, c = d + 1;
+                indices.insert(indices.end(), { a, b, c, c, d, a });
+            }
+        }
+    }
+
+    // cells along an edge: odd, so no vertex lands where a normal
+    // interpolated between opposite corners is zero
+    int cellCount(float edge) const
+    {
+        int cells = std::min(255, std::max(1, static_cast<int>(std::ceil(edge / bakeCell))));
+        return cells | 1;
+    }
+};
+
+#endif
@@ -0,0 +1,227 @@
+#ifndef MESH_BUFFER_H
+#define MESH_BUFFER_H
+
+#include <glad/glad.h>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// A static mesh on the GPU: a vertex buffer for locations 0 (position) and
+// 1 (normal) plus an index buffer. upload() takes the usual interleaved
+// position/normal floats and picks the smallest layout that still holds the
+// mesh:
+//   - packed vertices (12 bytes instead of 24): half-float positions and a
+//     10:10:10:2 signed normalized normal, used when every position survives
+//     the round trip to half precision
+//   - GL_UNSIGNED_SHORT indices when there are at most 65536 vertices
+// Meshes that mix materials (merged static geometry) can also carry a
+// material id per vertex, read at the location of the instance material.
+class MeshBuffer
+{
+public:
+    // largest position error accepted from half precision, in model units
+    static constexpr float HALF_TOLERANCE = 1.0e-3f;
+    static const GLuint MATERIAL_LOCATION = 6;
+
+    unsigned int VBO = 0, EBO = 0, materialVBO = 0;
+    bool packedVertices = false;
+    GLenum indexType = GL_UNSIGNED_INT;
+    GLsizei indexCount = 0;
+    size_t vertexCount = 0;
+
+    MeshBuffer() {}
+
+    MeshBuffer(const std::vector<float>& vertices, const std::vector<unsigned int>& indices, bool allowPacked = true)
+    {
+        upload(vertices, indices, allowPacked);
+    }
+
+    ~MeshBuffer()
+    {
+        if (VBO)
+        {
+            glDeleteBuffers(1, &VBO);
+            glDeleteBuffers(1, &EBO);
+        }
+        if (materialVBO)
+            glDeleteBuffers(1, &materialVBO);
+    }
+
+    MeshBuffer(const MeshBuffer&) = delete;
+    MeshBuffer& operator=(const MeshBuffer&) = delete;
+
+    // vertices: x, y, z, nx, ny, nz per vertex; materials, if given, one id per vertex
+    void upload(const std::vector<float>& vertices, const std::vector<unsigned int>& indices, bool allowPacked = true,
+                const std::vector<unsigned int>* materials = nullptr)
+    {
+        if (!VBO)
+        {
+            glGenBuffers(1, &VBO);
+            glGenBuffers(1, &EBO);
+        }
+        vertexCount = vertices.size() / 6;
+        indexCount = static_cast<GLsizei>(indices.size());
+
+        packedVertices = allowPacked && fitsHalf(vertices);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        if (packedVertices)
+        {
+            std::vector<PackedVertex> packed(vertexCount);
+            for (size_t i = 0; i < vertexCount; ++i)
+            {
+                const float* v = &vertices[6 * i];
+                packed[i].position[0] = toHalf(v[0]);
+                packed[i].position[1] = toHalf(v[1]);
+                packed[i].position[2] = toHalf(v[2]);
+                packed[i].position[3] = 0;
+                packed[i].normal = packNormal(v[3], v[4], v[5]);
+            }
+            glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PackedVertex), packed.data(), GL_STATIC_DRAW);
+        }
+        else
+        {
+            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+        }
+        if (materials)
+        {
+            if (!materialVBO)
+                glGenBuffers(1, &materialVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, materialVBO);
+            glBufferData(GL_ARRAY_BUFFER, materials->size() * sizeof(unsigned int), materials->data(), GL_STATIC_DRAW);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // the element buffer binding is VAO state; unbind any VAO so it isn't changed
+        glBindVertexArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        if (vertexCount <= 65536)
+        {
+            indexType = GL_UNSIGNED_SHORT;
+            std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(uint16_t), shortIndices.data(), GL_STATIC_DRAW);
+        }
+        else
+        {
+            indexType = GL_UNSIGNED_INT;
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+
+    // set up locations 0 and 1 and the index buffer of the currently bound VAO
+    void bindAttributes() const
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        if (packedVertices)
+        {
+            glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+            glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+        }
+        else
+        {
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+        }
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        if (materialVBO)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, materialVBO);
+            glVertexAttribIPointer(MATERIAL_LOCATION, 1, GL_UNSIGNED_INT, 0, (void*)0);
+            glEnableVertexAttribArray(MATERIAL_LOCATION);
+            glVertexAttribDivisor(MATERIAL_LOCATION, 0);
+        }
+    }
+
+    // byte offset of an index, for glDraw*Elements*
+    const void* indexOffset(GLsizei firstIndex) const
+    {
+        return (const void*)(firstIndex * static_cast<size_t>(indexType == GL_UNSIGNED_SHORT ? 2 : 4));
+    }
+
+    size_t vertexBytes() const
+    {
+        return vertexCount * (packedVertices ? sizeof(PackedVertex) : 6 * sizeof(float));
+    }
+
+    size_t indexBytes() const
+    {
+        return indexCount * static_cast<size_t>(indexType == GL_UNSIGNED_SHORT ? 2 : 4);
+    }
+
+    // float to IEEE half, rounded to nearest; values past the half range become infinity
+    static uint16_t toHalf(float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        uint32_t sign = (bits >> 16) & 0x8000;
+        int exponent = static_cast<int>((bits >> 23) & 0xFF) - 127 + 15;
+        uint32_t mantissa = bits & 0x7FFFFF;
+        if (exponent <= 0)
+        {
+            // subnormal half (or zero)
+            if (exponent < -10)
+                return static_cast<uint16_t>(sign);
+            mantissa |= 0x800000;
+            int shift = 14 - exponent;
+            uint32_t half = mantissa >> shift;
+            if ((mantissa >> (shift - 1)) & 1)
+                ++half;
+            return static_cast<uint16_t>(sign | half);
+        }
+        if (exponent >= 31)
+            return static_cast<uint16_t>(sign | 0x7C00);
+        uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+        if (mantissa & 0x1000)
+            ++half; // a carry into the exponent is still the correctly rounded value
+        return static_cast<uint16_t>(half);
+    }
+
+    static float fromHalf(uint16_t half)
+    {
+        int exponent = (half >> 10) & 0x1F;
+        int mantissa = half & 0x3FF;
+        float magnitude;
+        if (exponent == 0)
+            magnitude = std::ldexp(static_cast<float>(mantissa), -24);
+        else if (exponent == 31)
+            magnitude = HUGE_VALF;
+        else
+            magnitude = std::ldexp(static_cast<float>(mantissa | 0x400), exponent - 25);
+        return (half & 0x8000) ? -magnitude : magnitude;
+    }
+
+    // unit normal as GL_INT_2_10_10_10_REV: x in the low 10 bits, w = 0
+    static uint32_t packNormal(float x, float y, float z)
+    {
+        return snorm10(x) | (snorm10(y) << 10) | (snorm10(z) << 20);
+    }
+
+private:
+    struct PackedVertex
+    {
+        uint16_t position[4]; // half floats, w unused
+        uint32_t normal;
+    };
+
+    static uint32_t snorm10(float value)
+    {
+        value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+        int quantized = static_cast<int>(std::lround(value * 511.0f));
+        return static_cast<uint32_t>(quantized) & 0x3FF;
+    }
+
+    static bool fitsHalf(const std::vector<float>& vertices)
+    {
+        for (size_t i = 0; i + 5 < vertices.size(); i += 6)
+            for (int axis = 0; axis < 3; ++axis)
+                if (std::fabs(fromHalf(toHalf(vertices[i + axis])) - vertices[i + axis]) > HALF_TOLERANCE)
+                    return false;
+        return true;
+    }
+};
+
+#endif
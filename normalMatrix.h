@@ -0,0 +1,33 @@
+#ifndef NORMAL_MATRIX_H
+#define NORMAL_MATRIX_H
+
+#include <glm/glm.hpp>
+#include <cmath>
+
+// Normal matrix (inverse-transpose of the upper 3x3) for a model matrix.
+//
+// Everything in the restaurant is built from translate/rotate/scale, so the
+// upper 3x3 is almost always R * S: mutually orthogonal columns c_i = r_i * s_i.
+// For that case inverse(M)^T = R * S^-1, i.e. each column divided by its
+// squared length, which avoids the general inverse entirely. Anything with
+// shear (non-orthogonal columns) falls back to the full inverse-transpose.
+inline glm::mat3 computeNormalMatrix(const glm::mat4& model)
+{
+    glm::mat3 m(model);
+    float len0 = glm::dot(m[0], m[0]);
+    float len1 = glm::dot(m[1], m[1]);
+    float len2 = glm::dot(m[2], m[2]);
+
+    const float tolerance = 1e-4f;
+    bool orthogonal =
+        std::fabs(glm::dot(m[0], m[1])) <= tolerance * std::sqrt(len0 * len1) &&
+        std::fabs(glm::dot(m[0], m[2])) <= tolerance * std::sqrt(len0 * len2) &&
+        std::fabs(glm::dot(m[1], m[2])) <= tolerance * std::sqrt(len1 * len2);
+
+    if (orthogonal && len0 > 0.0f && len1 > 0.0f && len2 > 0.0f)
+        return glm::mat3(m[0] / len0, m[1] / len1, m[2] / len2);
+
+    return glm::transpose(glm::inverse(m));
+}
+
+#endif
@@ -0,0 +1,11 @@
+#version 330 core
+
+in vec3 Normal;
+
+out vec4 FragColor;
+
+void main()
+{
+    // reads Normal so the compiler can't drop the normal computation
+    FragColor = vec4(normalize(Normal) * 0.5 + 0.5, 1.0);
+}
@@ -0,0 +1,20 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in mat4 aInstanceModel;
+layout (location = 7) in mat3 aInstanceNormalMatrix;
+
+out vec3 Normal;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform bool perVertexInverse; // true = old path, inverse-transpose for every vertex
+
+void main()
+{
+    gl_Position = projection * view * aInstanceModel * vec4(aPos, 1.0);
+    if (perVertexInverse)
+        Normal = mat3(transpose(inverse(aInstanceModel))) * aNormal;
+    else
+        Normal = aInstanceNormalMatrix * aNormal;
+}
@@ -3,7 +3,8 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
-#include "shader.h"
+#include <cmath>
+#include <limits>
 
 class PointLight {
 public:
@@ -28,99 +29,92 @@ public:
         lightNumber = num;
     }
 
-    void setUpPointLight(Shader& lightingShader)
-    {
-        lightingShader.use();
-
-        if (lightNumber == 1) {
-            lightingShader.setVec3("pointLights[0].position", position);
-            lightingShader.setVec3("pointLights[0].ambient", ambient * ambientOn * isOn);
-            lightingShader.setVec3("pointLights[0].diffuse", diffuse * diffuseOn * isOn);
-            lightingShader.setVec3("pointLights[0].specular", specular * specularOn * isOn);
-            lightingShader.setFloat("pointLights[0].k_c", k_c);
-            lightingShader.setFloat("pointLights[0].k_l", k_l);
-            lightingShader.setFloat("pointLights[0].k_q", k_q);
-        }
+    // light colors with the on/off and per-component toggles applied
+    glm::vec3 effectiveAmbient() const { return ambient * ambientOn * isOn; }
+    glm::vec3 effectiveDiffuse() const { return diffuse * diffuseOn * isOn; }
+    glm::vec3 effectiveSpecular() const { return specular * specularOn * isOn; }
 
-        else if (lightNumber == 2)
-        {
-            lightingShader.setVec3("pointLights[1].position", position);
-            lightingShader.setVec3("pointLights[1].ambient", ambient * ambientOn * isOn);
-            lightingShader.setVec3("pointLights[1].diffuse", diffuse * diffuseOn * isOn);
-            lightingShader.setVec3("pointLights[1].specular", specular * specularOn * isOn);
-            lightingShader.setFloat("pointLights[1].k_c", k_c);
-            lightingShader.setFloat("pointLights[1].k_l", k_l);
-            lightingShader.setFloat("pointLights[1].k_q", k_q);
-        }
-        else if (lightNumber == 3)
-        {
-            lightingShader.setVec3("pointLights[2].position", position);
-            lightingShader.setVec3("pointLights[2].ambient", ambient * ambientOn * isOn);
-            lightingShader.setVec3("pointLights[2].diffuse", diffuse * diffuseOn * isOn);
-            lightingShader.setVec3("pointLights[2].specular", specular * specularOn * isOn);
-            lightingShader.setFloat("pointLights[2].k_c", k_c);
-            lightingShader.setFloat("pointLights[2].k_l", k_l);
-            lightingShader.setFloat("pointLights[2].k_q", k_q);
-        }
-        else
-        {
-            lightingShader.setVec3("pointLights[3].position", position);
-            lightingShader.setVec3("pointLights[3].ambient", ambient * ambientOn * isOn);
-            lightingShader.setVec3("pointLights[3].diffuse", diffuse * diffuseOn * isOn);
-            lightingShader.setVec3("pointLights[3].specular", specular * specularOn * isOn);
-            lightingShader.setFloat("pointLights[3].k_c", k_c);
-            lightingShader.setFloat("pointLights[3].k_l", k_l);
-            lightingShader.setFloat("pointLights[3].k_q", k_q);
-        }
+    // distance at which the attenuated light drops below one 8-bit step,
+    // i.e. k_c + k_l*d + k_q*d^2 = 256 * brightest channel. Lights that are
+    // off (or black) have range 0.
+    float range() const
+    {
+        glm::vec3 peak = glm::max(effectiveAmbient(), glm::max(effectiveDiffuse(), effectiveSpecular()));
+        float intensity = glm::max(peak.x, glm::max(peak.y, peak.z));
+        float c = k_c - 256.0f * intensity;
+        if (c >= 0.0f)
+            return 0.0f;
+        if (k_q > 0.0f)
+            return (-k_l + std::sqrt(k_l * k_l - 4.0f * k_q * c)) / (2.0f * k_q);
+        if (k_l > 0.0f)
+            return -c / k_l;
+        return std::numeric_limits<float>::max(); // no falloff
     }
 
+    // set whenever the light changes so LightBuffer knows to re-upload it.
+    // Call markDirty() after editing the public members directly.
+    bool isDirty() const { return dirty; }
+    void markDirty() { dirty = true; }
+    void clearDirty() { dirty = false; }
+
     void turnOff()
     {
         isOn = 0.0;
+        dirty = true;
     }
     void turnOn()
     {
         isOn = 1.0;
+        dirty = true;
     }
     void turnAmbientOn()
     {
         ambientOn = 1.0;
+        dirty = true;
     }
     void turnAmbientOff()
     {
         ambientOn = 0.0;
+        dirty = true;
     }
     void turnDiffuseOn()
     {
         diffuseOn = 1.0;
+        dirty = true;
     }
     void turnDiffuseOff()
     {
         diffuseOn = 0.0;
+        dirty = true;
     }
     void turnSpecularOn()
     {
         specularOn = 1.0;
+        dirty = true;
     }
     void turnSpecularOff()
     {
         specularOn = 0.0;
+        dirty = true;
     }
 
     // Add these new methods for dynamic updates
     void setAmbient(const glm::vec3& amb)
     {
         ambient = amb;
+        dirty = true;
     }
 
     void setDiffuse(const glm::vec3& diff)
     {
         diffuse = diff;
+        dirty = true;
     }
 
     void setSpecular(const glm::vec3& spec)
     {
         specular = spec;
+        dirty = true;
     }
 
 private:
@@ -128,6 +122,8 @@ private:
     float diffuseOn = 1.0;
     float specularOn = 1.0;
     float isOn = 1.0;
+
+    bool dirty = true;
 };
 
 #endif /* pointLight_h */
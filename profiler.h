@@ -0,0 +1,390 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Frame profiler. CPU scopes (CpuTimer) may nest and may run on any thread.
+// GPU scopes (GpuTimer) wrap GL work in GL_TIME_ELAPSED queries. Those can't
+// nest, so an inner GPU scope is ignored. Queries go into a ring of
+// FRAMES_IN_FLIGHT sets and are read back that many frames later, so the
+// CPU never waits on a result. A frame's record is complete once its GPU
+// times arrive. With recording on, every record is kept for export as CSV
+// (one row per frame) or as Chrome trace JSON (chrome://tracing, Perfetto).
+class Profiler
+{
+public:
+    static const int FRAMES_IN_FLIGHT = 4;
+    static const int MAX_GPU_SCOPES = 32;
+
+    struct Sample
+    {
+        const char* name; // string literal
+        double startMs;   // since the profiler was created
+        double durationMs;
+        int depth;
+        int thread;       // 0 = GPU, 1 = main thread, 2+ = workers
+    };
+
+    struct FrameRecord
+    {
+        long frame = -1;
+        double startMs = 0.0;
+        double cpuMs = 0.0; // beginFrame to endFrame
+        double gpuMs = 0.0; // sum of the GPU scopes
+        bool gpuValid = false;
+        int visible = 0, culled = 0; // scene nodes drawn and culled, see setCullCounts()
+        std::vector<Sample> cpu;
+        std::vector<Sample> gpu;
+    };
+
+    static Profiler& get()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    // keep every completed frame for writeCsv()/writeChromeTrace()
+    void setRecording(bool enabled)
+    {
+        recording = enabled;
+    }
+
+    void beginFrame()
+    {
+        if (!queriesCreated)
+            createQueries();
+        ++frameIndex;
+        FrameSlot& slot = slots[frameIndex % FRAMES_IN_FLIGHT];
+        if (slot.record.frame >= 0)
+            resolve(slot, false);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        current = FrameRecord();
+        current.frame = frameIndex;
+        current.startMs = now();
+        inFrame = true;
+    }
+
+    void endFrame()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (gpuScopeOpen)
+        {
+            glEndQuery(GL_TIME_ELAPSED);
+            gpuScopeOpen = false;
+        }
+        current.cpuMs = now() - current.startMs;
+        std::swap(slots[frameIndex % FRAMES_IN_FLIGHT].record, current);
+        inFrame = false;
+    }
+
+    // block until every frame still in flight has its GPU times; call before exporting
+    void flush()
+    {
+        for (int i = 1; i <= FRAMES_IN_FLIGHT; ++i)
+        {
+            FrameSlot& slot = slots[(frameIndex + i) % FRAMES_IN_FLIGHT];
+            if (slot.record.frame >= 0)
+                resolve(slot, true);
+        }
+    }
+
+    // culling results of the current frame, exported next to its times
+    void setCullCounts(int visible, int culled)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current.visible = visible;
+        current.culled = culled;
+    }
+
+    // most recent frame whose GPU times are in
+    const FrameRecord& latest() const
+    {
+        return latestRecord;
+    }
+
+    // frames whose GPU results weren't ready after FRAMES_IN_FLIGHT frames
+    unsigned int droppedGpuFrames() const
+    {
+        return droppedGpu;
+    }
+
+    void addCpuSample(const char* name, double startMs, double endMs, int depth)
+    {
+        Sample sample = { name, startMs, endMs - startMs, depth, threadNumber() };
+        std::lock_guard<std::mutex> lock(mutex);
+        if (inFrame)
+            current.cpu.push_back(sample);
+        else
+            unframed.push_back(sample); // startup work, e.g. building the scene
+    }
+
+    void beginGpu(const char* name)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        FrameSlot& slot = slots[frameIndex % FRAMES_IN_FLIGHT];
+        if (!inFrame || gpuScopeOpen || slot.used >= MAX_GPU_SCOPES)
+            return;
+        slot.names[slot.used] = name;
+        slot.starts[slot.used] = now();
+        glBeginQuery(GL_TIME_ELAPSED, slot.queries[slot.used]);
+        ++slot.used;
+        gpuScopeOpen = true;
+        gpuScopeOwner = name;
+    }
+
+    void endGpu(const char* name)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!gpuScopeOpen || gpuScopeOwner != name)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        gpuScopeOpen = false;
+    }
+
+    double now() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    // one row per frame: total CPU and GPU time, the culling counts, then the
+    // summed time of every scope name
+    bool writeCsv(const std::string& path) const
+    {
+        std::ofstream out(path.c_str());
+        if (!out)
+            return false;
+        std::vector<const char*> cpuNames, gpuNames;
+        for (const FrameRecord& record : history)
+        {
+            collectNames(record.cpu, cpuNames);
+            collectNames(record.gpu, gpuNames);
+        }
+
+        out << "frame,cpu_frame_ms,gpu_frame_ms,visible,culled";
+        for (const char* name : cpuNames)
+            out << ",cpu:" << name;
+        for (const char* name : gpuNames)
+            out << ",gpu:" << name;
+        out << "\n";
+        for (const FrameRecord& record : history)
+        {
+            out << record.frame << "," << record.cpuMs << ",";
+            if (record.gpuValid)
+                out << record.gpuMs;
+            out << "," << record.visible << "," << record.culled;
+            for (const char* name : cpuNames)
+                out << "," << total(record.cpu, name);
+            for (const char* name : gpuNames)
+            {
+                out << ",";
+                if (record.gpuValid)
+                    out << total(record.gpu, name);
+            }
+            out << "\n";
+        }
+        return true;
+    }
+
+    // Chrome trace event format: one complete ("X") event per scope. GPU
+    // scopes only have a duration, so they are placed at the CPU time they
+    // were issued.
+    bool writeChromeTrace(const std::string& path) const
+    {
+        std::ofstream out(path.c_str());
+        if (!out)
+            return false;
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}},\n";
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"main\"}}";
+        for (const Sample& sample : unframed)
+            writeEvent(out, sample, -1);
+        for (const FrameRecord& record : history)
+        {
+            Sample frame = { "frame", record.startMs, record.cpuMs, 0, 1 };
+            writeEvent(out, frame, record.frame);
+            for (const Sample& sample : record.cpu)
+                writeEvent(out, sample, record.frame);
+            if (record.gpuValid)
+                for (const Sample& sample : record.gpu)
+                    writeEvent(out, sample, record.frame);
+        }
+        out << "\n]}\n";
+        return true;
+    }
+
+private:
+    struct FrameSlot
+    {
+        GLuint queries[MAX_GPU_SCOPES];
+        const char* names[MAX_GPU_SCOPES];
+        double starts[MAX_GPU_SCOPES];
+        int used = 0;
+        FrameRecord record;
+    };
+
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    std::mutex mutex;
+    FrameSlot slots[FRAMES_IN_FLIGHT];
+    bool queriesCreated = false;
+    long frameIndex = -1;
+    bool inFrame = false;
+    bool gpuScopeOpen = false;
+    const char* gpuScopeOwner = nullptr;
+    bool recording = false;
+    unsigned int droppedGpu = 0;
+    FrameRecord current;
+    FrameRecord latestRecord;
+    std::vector<FrameRecord> history;
+    std::vector<Sample> unframed;
+    std::vector<std::thread::id> threads;
+
+    Profiler() {}
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    void createQueries()
+    {
+        for (FrameSlot& slot : slots)
+            glGenQueries(MAX_GPU_SCOPES, slot.queries);
+        queriesCreated = true;
+    }
+
+    // read the slot's GPU times (without waiting unless asked to) and retire its record
+    void resolve(FrameSlot& slot, bool wait)
+    {
+        FrameRecord& record = slot.record;
+        record.gpuValid = true;
+        if (slot.used > 0 && !wait)
+        {
+            // queries complete in order, so the last one being ready means all are
+            GLuint available = 0;
+            glGetQueryObjectuiv(slot.queries[slot.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+            {
+                record.gpuValid = false;
+                ++droppedGpu;
+            }
+        }
+        if (record.gpuValid)
+        {
+            for (int i = 0; i < slot.used; ++i)
+            {
+                GLuint64 elapsed = 0;
+                glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &elapsed);
+                Sample sample = { slot.names[i], slot.starts[i], elapsed / 1.0e6, 0, 0 };
+                record.gpu.push_back(sample);
+                record.gpuMs += sample.durationMs;
+            }
+        }
+        slot.used = 0;
+
+        if (record.gpuValid)
+            latestRecord = record;
+        if (recording)
+            history.push_back(record);
+        record = FrameRecord();
+    }
+
+    int threadNumber()
+    {
+        std::thread::id id = std::this_thread::get_id();
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < threads.size(); ++i)
+            if (threads[i] == id)
+                return static_cast<int>(i) + 1;
+        threads.push_back(id); // the first thread to record is the main thread
+        return static_cast<int>(threads.size());
+    }
+
+    static void collectNames(const std::vector<Sample>& samples, std::vector<const char*>& names)
+    {
+        for (const Sample& sample : samples)
+        {
+            bool known = false;
+            for (const char* name : names)
+                if (std::string(name) == sample.name)
+                    known = true;
+            if (!known)
+                names.push_back(sample.name);
+        }
+    }
+
+    static double total(const std::vector<Sample>& samples, const char* name)
+    {
+        double sum = 0.0;
+        for (const Sample& sample : samples)
+            if (std::string(sample.name) == name)
+                sum += sample.durationMs;
+        return sum;
+    }
+
+    static void writeEvent(std::ofstream& out, const Sample& sample, long frame)
+    {
+        out << ",\n{\"name\":\"" << sample.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << sample.thread
+            << ",\"ts\":" << sample.startMs * 1000.0 << ",\"dur\":" << sample.durationMs * 1000.0
+            << ",\"args\":{\"frame\":" << frame << "}}";
+    }
+};
+
+// Times the enclosing scope on the CPU
+class CpuTimer
+{
+public:
+    explicit CpuTimer(const char* name)
+        : name(name), start(Profiler::get().now())
+    {
+        ++depth();
+    }
+
+    ~CpuTimer()
+    {
+        --depth();
+        Profiler::get().addCpuSample(name, start, Profiler::get().now(), depth());
+    }
+
+    CpuTimer(const CpuTimer&) = delete;
+    CpuTimer& operator=(const CpuTimer&) = delete;
+
+private:
+    const char* name;
+    double start;
+
+    static int& depth()
+    {
+        static thread_local int nesting = 0;
+        return nesting;
+    }
+};
+
+// Times the GL commands issued in the enclosing scope on the GPU
+class GpuTimer
+{
+public:
+    explicit GpuTimer(const char* name)
+        : name(name)
+    {
+        Profiler::get().beginGpu(name);
+    }
+
+    ~GpuTimer()
+    {
+        Profiler::get().endGpu(name);
+    }
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+private:
+    const char* name;
+};
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "glExtensions.h"
+
+// Linked shader programs kept on disk as driver binaries
+// (glGetProgramBinary/glProgramBinary), so later launches skip compiling
+// and linking. An entry is keyed by a hash of every source string together
+// with the driver's vendor, renderer and version strings. Anything that
+// doesn't load (a driver update, a damaged file, no binary support) falls
+// back to building from source, which then replaces the entry.
+class ProgramCache
+{
+public:
+    struct Stats
+    {
+        unsigned int hits = 0;   // programs loaded from a binary
+        unsigned int misses = 0; // programs built from source
+        double milliseconds = 0.0; // spent creating programs either way
+    };
+    Stats stats;
+
+    static ProgramCache& get()
+    {
+        static ProgramCache cache;
+        return cache;
+    }
+
+    // where entries are kept; an empty directory turns the cache off
+    void setDirectory(const std::string& path)
+    {
+        directory = path;
+    }
+
+    bool enabled() const
+    {
+        return !directory.empty() && GLExtensions::get().programBinary;
+    }
+
+    // FNV-1a over the sources and the driver strings
+    uint64_t key(const std::vector<std::string>& sources)
+    {
+        if (driver.empty())
+        {
+            const char* strings[] = { (const char*)glGetString(GL_VENDOR), (const char*)glGetString(GL_RENDERER),
+                                      (const char*)glGetString(GL_VERSION) };
+            for (const char* s : strings)
+                driver += std::string(s ? s : "") + '\n';
+        }
+        uint64_t hash = 14695981039346656037ull;
+        hashBytes(hash, driver.data(), driver.size());
+        for (const std::string& source : sources)
+        {
+            uint64_t length = source.size(); // keeps "ab"+"c" apart from "a"+"bc"
+            hashBytes(hash, &length, sizeof(length));
+            hashBytes(hash, source.data(), source.size());
+        }
+        return hash;
+    }
+
+    // ask the driver to keep the binary of a program that is about to be linked
+    void prepare(GLuint program) const
+    {
+        if (enabled())
+            GLExtensions::get().programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // link program from the entry for key; false leaves it unlinked, ready to build from source
+    bool load(GLuint program, uint64_t entryKey) const
+    {
+        if (!enabled())
+            return false;
+        std::ifstream in(path(entryKey).c_str(), std::ios::binary);
+        EntryHeader header;
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, magic(), sizeof(header.magic)) != 0 ||
+            header.key != entryKey || header.length == 0)
+            return false;
+        std::vector<char> binary(header.length);
+        if (!in.read(binary.data(), binary.size()))
+            return false;
+        GLExtensions::get().programBinaryFrom(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        return linked == GL_TRUE;
+    }
+
+    // write the binary of a freshly linked program
+    void store(GLuint program, uint64_t entryKey) const
+    {
+        if (!enabled())
+            return;
+        GLint linked = GL_FALSE, length = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (linked != GL_TRUE || length <= 0)
+            return;
+        std::vector<char> binary(length);
+        EntryHeader header;
+        std::memcpy(header.magic, magic(), sizeof(header.magic));
+        header.key = entryKey;
+        GLsizei written = 0;
+        GLExtensions::get().getProgramBinary(program, length, &written, &header.format, binary.data());
+        if (written <= 0)
+            return;
+        header.length = static_cast<uint32_t>(written);
+
+        makeDirectory();
+        // write to a temporary first so a crash never leaves half an entry behind
+        std::string finalPath = path(entryKey), temporary = finalPath + ".tmp";
+        {
+            std::ofstream out(temporary.c_str(), std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(binary.data(), header.length);
+            if (!out)
+                return;
+        }
+        std::remove(finalPath.c_str());
+        std::rename(temporary.c_str(), finalPath.c_str());
+    }
+
+private:
+    struct EntryHeader
+    {
+        char magic[8];
+        uint64_t key;
+        GLenum format;
+        uint32_t length;
+    };
+
+    std::string directory = "shader_cache";
+    std::string driver;
+
+    ProgramCache() {}
+
+    static const char* magic()
+    {
+        return "PRGBIN01";
+    }
+
+    std::string path(uint64_t entryKey) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(entryKey));
+        return directory + "/" + name;
+    }
+
+    void makeDirectory() const
+    {
+#ifdef _WIN32
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+    }
+
+    static void hashBytes(uint64_t& hash, const void* data, size_t size)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef RENDER_LIST_H
+#define RENDER_LIST_H
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// One submission: a 64-bit sort key and the item to draw
+struct RenderCommand
+{
+    uint64_t key;
+    int item; // index of what to draw, meaningful to whoever filled the list
+};
+
+// Per-frame list of draw submissions. Commands are sorted by key, i.e. by
+// shader, then VAO, then material, then front-to-back depth, so state changes
+// group together and near objects fill the depth buffer first. Submitting
+// the same thing twice is caught here: identical commands always share a key,
+// so after sorting they sit in the same run of equal keys and are dropped.
+class RenderList
+{
+public:
+    // key layout: shader (8 bits) | VAO (8) | material (16) | depth (32)
+    static uint64_t makeKey(unsigned int shader, unsigned int vao, unsigned int material, float depth)
+    {
+        // non-negative floats order the same as their bit patterns
+        if (!(depth > 0.0f))
+            depth = 0.0f;
+        uint32_t depthBits;
+        std::memcpy(&depthBits, &depth, sizeof(depthBits));
+        return (uint64_t(shader & 0xFF) << 56) | (uint64_t(vao & 0xFF) << 48) | (uint64_t(material & 0xFFFF) << 32) | depthBits;
+    }
+
+    static unsigned int vaoOf(uint64_t key)
+    {
+        return static_cast<unsigned int>((key >> 48) & 0xFF);
+    }
+
+    void clear()
+    {
+        list.clear();
+        redundant.clear();
+    }
+
+    void add(uint64_t key, int item)
+    {
+        RenderCommand command = { key, item };
+        list.push_back(command);
+    }
+
+    // add commands generated elsewhere, e.g. in a per-thread buffer
+    void append(const RenderCommand* commands, size_t count)
+    {
+        list.insert(list.end(), commands, commands + count);
+    }
+
+    // sort by key and drop every command for which sameDraw(earlier, later)
+    // holds against an earlier command with the same key
+    template <typename SameDraw>
+    void finalize(SameDraw sameDraw)
+    {
+        radixSort();
+
+        size_t kept = 0;
+        size_t runStart = 0;
+        for (size_t i = 0; i < list.size(); ++i)
+        {
+            if (kept == 0 || list[i].key != list[kept - 1].key)
+                runStart = kept;
+            bool duplicate = false;
+            for (size_t j = runStart; j < kept && !duplicate; ++j)
+            {
+                if (sameDraw(list[j].item, list[i].item))
+                {
+                    redundant.push_back(std::make_pair(list[i].item, list[j].item));
+                    duplicate = true;
+                }
+            }
+            if (!duplicate)
+                list[kept++] = list[i];
+        }
+        list.resize(kept);
+    }
+
+    const std::vector<RenderCommand>& commands() const
+    {
+        return list;
+    }
+
+    // (dropped item, item it repeated) for every command finalize() removed
+    const std::vector<std::pair<int, int> >& redundantDraws() const
+    {
+        return redundant;
+    }
+
+private:
+    std::vector<RenderCommand> list;
+    std::vector<RenderCommand> scratch;
+    std::vector<std::pair<int, int> > redundant;
+
+    // LSD radix sort on 8-bit digits; stable, so equal keys keep submission order.
+    // Digits that are the same for every command are skipped.
+    void radixSort()
+    {
+        if (list.size() < 2)
+            return;
+        scratch.resize(list.size());
+        for (int shift = 0; shift < 64; shift += 8)
+        {
+            size_t counts[256] = {};
+            for (const RenderCommand& command : list)
+                ++counts[(command.key >> shift) & 0xFF];
+            if (counts[(list[0].key >> shift) & 0xFF] == list.size())
+                continue;
+
+            size_t offsets[256];
+            size_t sum = 0;
+            for (int digit = 0; digit < 256; ++digit)
+            {
+                offsets[digit] = sum;
+                sum += counts[digit];
+            }
+            for (const RenderCommand& command : list)
+                scratch[offsets[(command.key >> shift) & 0xFF]++] = command;
+            list.swap(scratch);
+        }
+    }
+};
+
+#endif
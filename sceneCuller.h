@@ -0,0 +1,243 @@
+#ifndef SCENE_CULLER_H
+#define SCENE_CULLER_H
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "bvh.h"
+#include "jobSystem.h"
+#include "sceneGraph.h"
+#include "instancedRenderer.h"
+#include "renderList.h"
+#include "sphere.h"
+
+// View-frustum culling for every drawable node of a SceneGraph. The BVH is
+// built once from the nodes' world boxes; dynamic nodes (the fan) are refit
+// after they move. The visible nodes go through a RenderList, which orders
+// them by batch, material and depth and drops draws that repeat an earlier
+// one. There is a static and a dynamic batch per mesh: the cube and each
+// sphere level of detail, picked from the sphere's size on screen; nodes
+// baked into the merged static geometry form one more batch. Static
+// instances keep the attributes baked at load time and a static batch is
+// only re-uploaded when its sorted contents change, so a camera that isn't
+// moving costs no upload at all. Render commands and instance data are
+// generated in parallel on a JobSystem: each thread writes its own command
+// buffer, and the buffers are merged back in visible order on the calling
+// (GL) thread, so the result is the same for any number of threads.
+class SceneCuller
+{
+public:
+    // mesh 0 is the cube, mesh 1 + i is sphere level of detail i
+    static const int MESH_COUNT = 1 + SphereLODs::LEVELS;
+
+    SceneCuller(const SceneGraph& scene, JobSystem& jobs)
+        : scene(scene), jobs(jobs), threadCommands(jobs.threadCount())
+    {
+        std::vector<AABB> bounds;
+        for (int node = 0; node < scene.size(); ++node)
+        {
+            if (!(scene.flags[node] & SceneGraph::DRAWABLE))
+                continue;
+            int primitive = static_cast<int>(nodes.size());
+            nodes.push_back(node);
+            bounds.push_back(AABB::fromUnitCube(scene.world[node]));
+            if (scene.flags[node] & SceneGraph::DYNAMIC)
+            {
+                dynamicPrimitives.push_back(primitive);
+                bakedInstances.push_back(InstanceData());
+            }
+            else
+            {
+                bakedInstances.push_back(scene.instance(node));
+            }
+        }
+        bvh.build(bounds);
+    }
+
+    // refresh the boxes of moving nodes; call after SceneGraph::updateWorld()
+    void refitDynamic()
+    {
+        for (int primitive : dynamicPrimitives)
+            bvh.refit(primitive, AABB::fromUnitCube(scene.world[nodes[primitive]]));
+    }
+
+    const CullStats& cull(const glm::mat4& projectionView)
+    {
+        bvh.cull(Frustum::fromMatrix(projectionView), visible, stats);
+        return stats;
+    }
+
+    // queue the visible nodes in the render list; call after cull().
+    // pixelsPerUnit is the on-screen size of one world unit at distance 1,
+    // i.e. viewport height / (2 * tan(fovy / 2)).
+    void buildRenderList(const glm::mat4& view, float pixelsPerUnit)
+    {
+        renderList.clear();
+        glm::vec4 depthRow(-view[0][2], -view[1][2], -view[2][2], -view[3][2]);
+        for (CommandBuffer& buffer : threadCommands)
+        {
+            buffer.commands.clear();
+            buffer.spans.clear();
+        }
+        jobs.parallelFor(static_cast<int>(visible.size()), JOB_GRAIN, [&](int begin, int end, unsigned int thread) {
+            CommandBuffer& buffer = threadCommands[thread];
+            Span span = { begin, thread, buffer.commands.size(), 0 };
+            for (int i = begin; i < end; ++i)
+            {
+                RenderCommand command = { commandKey(visible[i], depthRow, pixelsPerUnit), visible[i] };
+                buffer.commands.push_back(command);
+            }
+            span.count = buffer.commands.size() - span.first;
+            buffer.spans.push_back(span);
+        });
+
+        // merge the per-thread buffers in visible order, so equal keys sort
+        // exactly as if one thread had generated them all
+        spans.clear();
+        for (const CommandBuffer& buffer : threadCommands)
+            spans.insert(spans.end(), buffer.spans.begin(), buffer.spans.end());
+        std::sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) { return a.begin < b.begin; });
+        for (const Span& span : spans)
+            renderList.append(threadCommands[span.thread].commands.data() + span.first, span.count);
+        renderList.finalize([this](int first, int second) { return sameDraw(nodes[first], nodes[second]); });
+#ifndef NDEBUG
+        reportRedundant();
+#endif
+
+        for (std::vector<int>& items : batchItems)
+            items.clear();
+        for (const RenderCommand& command : renderList.commands())
+            batchItems[RenderList::vaoOf(command.key)].push_back(command.item);
+    }
+
+    // gather the visible static nodes drawn with mesh into batch; uploads and
+    // returns true only if they differ from the previous call
+    bool gatherStatic(int mesh, InstancedRenderer& batch)
+    {
+        const std::vector<int>& items = batchItems[2 * mesh];
+        if (uploadedOnce[mesh] && items == uploadedStatic[mesh])
+            return false;
+
+        InstanceData* instances = batch.beginFill(items.size());
+        jobs.parallelFor(static_cast<int>(items.size()), JOB_GRAIN, [&](int begin, int end, unsigned int) {
+            for (int i = begin; i < end; ++i)
+                instances[i] = bakedInstances[items[i]];
+        });
+        batch.upload();
+        uploadedStatic[mesh] = items;
+        uploadedOnce[mesh] = true;
+        return true;
+    }
+
+    // gather the visible dynamic nodes drawn with mesh at their current transforms
+    void gatherDynamic(int mesh, InstancedRenderer& batch) const
+    {
+        const std::vector<int>& items = batchItems[2 * mesh + 1];
+        InstanceData* instances = batch.beginFill(items.size());
+        jobs.parallelFor(static_cast<int>(items.size()), JOB_GRAIN, [&](int begin, int end, unsigned int) {
+            for (int i = begin; i < end; ++i)
+                instances[i] = scene.instance(nodes[items[i]]);
+        });
+    }
+
+    // the visible nodes of the merged static geometry
+    void gatherMerged(std::vector<int>& mergedNodes) const
+    {
+        mergedNodes.clear();
+        for (int primitive : batchItems[MERGED_BATCH])
+            mergedNodes.push_back(nodes[primitive]);
+    }
+
+    const CullStats& lastStats() const
+    {
+        return stats;
+    }
+
+    // draws dropped from the last render list as repeats of another draw
+    int redundantDraws() const
+    {
+        return static_cast<int>(renderList.redundantDraws().size());
+    }
+
+private:
+    // a run of commands one job generated, for visible[begin, begin + count)
+    struct Span
+    {
+        int begin;
+        unsigned int thread;
+        size_t first, count; // in that thread's buffer
+    };
+
+    struct CommandBuffer
+    {
+        std::vector<RenderCommand> commands;
+        std::vector<Span> spans;
+    };
+
+    static const int JOB_GRAIN = 256; // nodes per job; smaller pieces cost more in scheduling than they save
+
+    const SceneGraph& scene;
+    JobSystem& jobs;
+    BVH bvh;
+    RenderList renderList;
+    std::vector<CommandBuffer> threadCommands;
+    std::vector<Span> spans;
+    std::vector<int> nodes;                  // scene node of every BVH primitive
+    std::vector<int> dynamicPrimitives;
+    std::vector<InstanceData> bakedInstances; // static nodes only
+    std::vector<int> visible;
+    static const unsigned int MERGED_BATCH = 2 * MESH_COUNT;
+
+    std::vector<int> batchItems[MERGED_BATCH + 1]; // visible primitives per batch, in render list order
+    std::vector<int> uploadedStatic[MESH_COUNT];
+    bool uploadedOnce[MESH_COUNT] = {};
+    CullStats stats;
+#ifndef NDEBUG
+    std::vector<int> reported;
+#endif
+
+    // batch (mesh, static or dynamic, or merged), material and depth of a visible primitive
+    uint64_t commandKey(int primitive, const glm::vec4& depthRow, float pixelsPerUnit) const
+    {
+        int node = nodes[primitive];
+        const glm::mat4& world = scene.world[node];
+        float depth = glm::dot(depthRow, world[3]);
+        int mesh = 0;
+        if (scene.mesh[node] == SceneGraph::SPHERE)
+        {
+            float radius = 0.5f * std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+            mesh = 1 + SphereLODs::select(radius * pixelsPerUnit / std::max(depth, 0.1f));
+        }
+        unsigned int batch = 2 * mesh + ((scene.flags[node] & SceneGraph::DYNAMIC) ? 1 : 0);
+        if (scene.flags[node] & SceneGraph::MERGED)
+            batch = MERGED_BATCH;
+        return RenderList::makeKey(0, batch, scene.material[node], depth);
+    }
+
+    // the same mesh with the same material at the same place
+    bool sameDraw(int first, int second) const
+    {
+        return scene.mesh[first] == scene.mesh[second] && scene.material[first] == scene.material[second] &&
+               std::memcmp(&scene.world[first], &scene.world[second], sizeof(glm::mat4)) == 0;
+    }
+
+#ifndef NDEBUG
+    // name every node that was submitted twice, once per node
+    void reportRedundant()
+    {
+        for (const std::pair<int, int>& draw : renderList.redundantDraws())
+        {
+            int dropped = nodes[draw.first], kept = nodes[draw.second];
+            if (std::find(reported.begin(), reported.end(), dropped) != reported.end())
+                continue;
+            reported.push_back(dropped);
+            std::cout << "Redundant draw: scene node " << dropped << " repeats node " << kept << std::endl;
+        }
+    }
+#endif
+};
+
+#endif
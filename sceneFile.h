@@ -0,0 +1,493 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "mappedFile.h"
+#include "materialLibrary.h"
+#include "sceneGraph.h"
+
+// One light of a scene file
+struct SceneLight
+{
+    enum Type : uint32_t { DIRECTIONAL = 0, POINT = 1 };
+
+    uint32_t type;
+    glm::vec3 vector; // direction of a directional light, position of a point light
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+    float k_c, k_l, k_q; // point light attenuation
+};
+
+// Scene description files, in two forms:
+//
+// Text, for authoring. One statement per line, '#' starts a comment:
+//   scene 1
+//   material <ambient rgb> <diffuse rgb> <specular rgb> <shininess>
+//   directional <direction xyz> <ambient rgb> <diffuse rgb> <specular rgb>
+//   point <position xyz> <ambient rgb> <diffuse rgb> <specular rgb> <k_c> <k_l> <k_q>
+//   node <parent> <none|cube|sphere> <material> <flags> <transform>...
+//   name <node> <identifier>
+// Materials and nodes are numbered from 0 in the order they appear; a
+// parent is an earlier node (or -1) whose subtree is still open, as in
+// SceneGraph::addNode. Flags are '-' or any of 'd' (dynamic) and 'm'
+// (merged). The transform is any sequence of "translate x y z",
+// "rotate degrees x y z", "scale x y z" and "matrix <16 floats, column-major>",
+// applied left to right as with glm::translate/rotate/scale.
+//
+// Compiled, for loading. A header followed by the SceneGraph arrays exactly
+// as they sit in memory, each on a 64-byte boundary, then the materials,
+// lights and names. The file is memory-mapped and the scene graph views the
+// mapping directly, so loading costs page faults rather than parsing and
+// allocation. The mapping is copy-on-write: the pages of nodes that move
+// (the fan) are copied on first write and the file itself never changes.
+class SceneFile
+{
+public:
+    static const uint32_t VERSION = 1;
+
+    struct Header
+    {
+        char magic[8];      // "RSCENE\0\0"
+        uint32_t byteOrder; // BYTE_ORDER as written; a mismatch means another endianness
+        uint32_t version;
+        uint32_t nodeCount, materialCount, lightCount, nameCount;
+        uint64_t parentOffset, subtreeEndOffset, localOffset, worldOffset;
+        uint64_t meshOffset, materialOffset, flagsOffset;
+        uint64_t materialsOffset, lightsOffset, namesOffset;
+    };
+
+    struct NameRecord
+    {
+        int32_t node;
+        char name[60]; // zero-terminated
+    };
+
+    std::vector<SceneLight> lights;
+
+    SceneFile() {}
+    SceneFile(const SceneFile&) = delete;
+    SceneFile& operator=(const SceneFile&) = delete;
+
+    // fill an empty scene from a text or compiled file, told apart by the
+    // magic number. A compiled file stays mapped for as long as this object
+    // lives, so it must outlive the scene.
+    bool load(const std::string& path, SceneGraph& scene)
+    {
+        std::ifstream probe(path.c_str(), std::ios::binary);
+        if (!probe)
+        {
+            std::cout << "Scene file not found: " << path << std::endl;
+            return false;
+        }
+        char magic[8] = {};
+        probe.read(magic, sizeof(magic));
+        probe.close();
+        if (std::memcmp(magic, magicNumber(), sizeof(magic)) == 0)
+            return loadCompiled(path, scene);
+        return loadText(path, scene);
+    }
+
+    // true if the scene's arrays view a mapped compiled file
+    bool isMapped() const
+    {
+        return mapping.data() != NULL;
+    }
+
+    static bool saveText(const std::string& path, const SceneGraph& scene, const std::vector<SceneLight>& sceneLights)
+    {
+        std::ofstream out(path.c_str());
+        if (!out)
+            return false;
+        out << "# restaurant scene, see sceneFile.h for the format\n";
+        out << "scene " << VERSION << "\n\n";
+        for (size_t id = 0; id < scene.materials.size(); ++id)
+        {
+            const Material& material = scene.materials[static_cast<unsigned int>(id)];
+            out << "material " << vec3Text(material.ambient) << "  " << vec3Text(material.diffuse) << "  "
+                << vec3Text(material.specular) << "  " << number(material.shininess) << "\n";
+        }
+        out << "\n";
+        for (const SceneLight& light : sceneLights)
+        {
+            out << (light.type == SceneLight::DIRECTIONAL ? "directional " : "point ") << vec3Text(light.vector) << "  "
+                << vec3Text(light.ambient) << "  " << vec3Text(light.diffuse) << "  " << vec3Text(light.specular);
+            if (light.type == SceneLight::POINT)
+                out << "  " << number(light.k_c) << " " << number(light.k_l) << " " << number(light.k_q);
+            out << "\n";
+        }
+        out << "\n";
+        for (int node = 0; node < scene.size(); ++node)
+        {
+            const char* meshName = !(scene.flags[node] & SceneGraph::DRAWABLE) ? "none" : (scene.mesh[node] == SceneGraph::SPHERE ? "sphere" : "cube");
+            std::string nodeFlags;
+            // children inherit the dynamic flag, so only subtree roots carry it
+            if ((scene.flags[node] & SceneGraph::DYNAMIC) && (scene.parent[node] == SceneGraph::ROOT || !(scene.flags[scene.parent[node]] & SceneGraph::DYNAMIC)))
+                nodeFlags += "d";
+            if (scene.flags[node] & SceneGraph::MERGED)
+                nodeFlags += "m";
+            out << "node " << scene.parent[node] << " " << meshName << " " << scene.material[node] << " "
+                << (nodeFlags.empty() ? "-" : nodeFlags) << " matrix";
+            const float* m = &scene.local[node][0][0];
+            for (int i = 0; i < 16; ++i)
+                out << " " << number(m[i]);
+            out << "\n";
+        }
+        for (const std::pair<std::string, int>& entry : scene.namedNodes())
+            out << "name " << entry.second << " " << entry.first << "\n";
+        return static_cast<bool>(out);
+    }
+
+    static bool saveCompiled(const std::string& path, const SceneGraph& scene, const std::vector<SceneLight>& sceneLights)
+    {
+        size_t count = static_cast<size_t>(scene.size());
+        std::vector<Material> materials;
+        for (size_t id = 0; id < scene.materials.size(); ++id)
+            materials.push_back(scene.materials[static_cast<unsigned int>(id)]);
+        std::vector<NameRecord> names;
+        for (const std::pair<std::string, int>& entry : scene.namedNodes())
+        {
+            NameRecord record = {};
+            record.node = entry.second;
+            std::strncpy(record.name, entry.first.c_str(), sizeof(record.name) - 1);
+            names.push_back(record);
+        }
+
+        Header header = {};
+        std::memcpy(header.magic, magicNumber(), sizeof(header.magic));
+        header.byteOrder = BYTE_ORDER_MARK;
+        header.version = VERSION;
+        header.nodeCount = static_cast<uint32_t>(count);
+        header.materialCount = static_cast<uint32_t>(materials.size());
+        header.lightCount = static_cast<uint32_t>(sceneLights.size());
+        header.nameCount = static_cast<uint32_t>(names.size());
+
+        uint64_t offset = sizeof(Header);
+        header.parentOffset = place(offset, count * sizeof(int));
+        header.subtreeEndOffset = place(offset, count * sizeof(int));
+        header.localOffset = place(offset, count * sizeof(glm::mat4));
+        header.worldOffset = place(offset, count * sizeof(glm::mat4));
+        header.meshOffset = place(offset, count * sizeof(unsigned char));
+        header.materialOffset = place(offset, count * sizeof(unsigned int));
+        header.flagsOffset = place(offset, count * sizeof(unsigned char));
+        header.materialsOffset = place(offset, materials.size() * sizeof(Material));
+        header.lightsOffset = place(offset, sceneLights.size() * sizeof(SceneLight));
+        header.namesOffset = place(offset, names.size() * sizeof(NameRecord));
+
+        std::ofstream out(path.c_str(), std::ios::binary);
+        if (!out)
+            return false;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        writeAt(out, header.parentOffset, scene.parent.data(), count * sizeof(int));
+        writeAt(out, header.subtreeEndOffset, scene.subtreeEnd.data(), count * sizeof(int));
+        writeAt(out, header.localOffset, scene.local.data(), count * sizeof(glm::mat4));
+        writeAt(out, header.worldOffset, scene.world.data(), count * sizeof(glm::mat4));
+        writeAt(out, header.meshOffset, scene.mesh.data(), count * sizeof(unsigned char));
+        writeAt(out, header.materialOffset, scene.material.data(), count * sizeof(unsigned int));
+        writeAt(out, header.flagsOffset, scene.flags.data(), count * sizeof(unsigned char));
+        writeAt(out, header.materialsOffset, materials.data(), materials.size() * sizeof(Material));
+        writeAt(out, header.lightsOffset, sceneLights.data(), sceneLights.size() * sizeof(SceneLight));
+        writeAt(out, header.namesOffset, names.data(), names.size() * sizeof(NameRecord));
+        return static_cast<bool>(out);
+    }
+
+private:
+    static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+    MappedFile mapping;
+
+    static const char* magicNumber()
+    {
+        return "RSCENE\0\0";
+    }
+
+    bool loadCompiled(const std::string& path, SceneGraph& scene)
+    {
+        if (!mapping.open(path))
+        {
+            std::cout << "Failed to map scene file: " << path << std::endl;
+            return false;
+        }
+        if (mapping.size() < sizeof(Header))
+        {
+            std::cout << "Scene file is truncated: " << path << std::endl;
+            mapping.close();
+            return false;
+        }
+        const Header& header = *reinterpret_cast<const Header*>(mapping.data());
+        size_t count = header.nodeCount;
+        if (header.byteOrder != BYTE_ORDER_MARK || header.version != VERSION ||
+            !fits(header.parentOffset, count * sizeof(int)) || !fits(header.subtreeEndOffset, count * sizeof(int)) ||
+            !fits(header.localOffset, count * sizeof(glm::mat4)) || !fits(header.worldOffset, count * sizeof(glm::mat4)) ||
+            !fits(header.meshOffset, count) || !fits(header.materialOffset, count * sizeof(unsigned int)) ||
+            !fits(header.flagsOffset, count) || !fits(header.materialsOffset, header.materialCount * sizeof(Material)) ||
+            !fits(header.lightsOffset, header.lightCount * sizeof(SceneLight)) || !fits(header.namesOffset, header.nameCount * sizeof(NameRecord)))
+        {
+            std::cout << "Scene file is damaged or from another version: " << path << std::endl;
+            mapping.close();
+            return false;
+        }
+
+        int* parents = at<int>(header.parentOffset);
+        int* subtreeEnds = at<int>(header.subtreeEndOffset);
+        unsigned char* meshes = at<unsigned char>(header.meshOffset);
+        unsigned int* materialIds = at<unsigned int>(header.materialOffset);
+        unsigned char* flags = at<unsigned char>(header.flagsOffset);
+        const unsigned char knownFlags = SceneGraph::DRAWABLE | SceneGraph::DYNAMIC | SceneGraph::MERGED;
+        for (size_t node = 0; node < count; ++node)
+        {
+            int i = static_cast<int>(node);
+            if (parents[node] < SceneGraph::ROOT || parents[node] >= i || subtreeEnds[node] <= i || subtreeEnds[node] > static_cast<int>(count))
+            {
+                std::cout << "Scene file has a broken hierarchy at node " << node << ": " << path << std::endl;
+                mapping.close();
+                return false;
+            }
+            bool drawable = (flags[node] & SceneGraph::DRAWABLE) != 0;
+            if (meshes[node] > SceneGraph::SPHERE || (flags[node] & ~knownFlags) != 0 ||
+                ((flags[node] & SceneGraph::MERGED) && !drawable) || (drawable && materialIds[node] >= header.materialCount))
+            {
+                std::cout << "Scene file has a broken mesh, material or flags at node " << node << ": " << path << std::endl;
+                mapping.close();
+                return false;
+            }
+        }
+        const NameRecord* names = at<NameRecord>(header.namesOffset);
+        for (uint32_t i = 0; i < header.nameCount; ++i)
+        {
+            if (names[i].node < 0 || names[i].node >= static_cast<int32_t>(count))
+            {
+                std::cout << "Scene file names a missing node " << names[i].node << ": " << path << std::endl;
+                mapping.close();
+                return false;
+            }
+        }
+
+        // materials are interned, so ids only change if the file holds duplicates
+        const Material* materials = at<Material>(header.materialsOffset);
+        std::vector<unsigned int> remap(header.materialCount);
+        bool identity = true;
+        for (uint32_t id = 0; id < header.materialCount; ++id)
+        {
+            remap[id] = scene.materials.intern(materials[id]);
+            identity = identity && remap[id] == id;
+        }
+        for (size_t node = 0; node < count && !identity; ++node)
+            if (materialIds[node] < header.materialCount)
+                materialIds[node] = remap[materialIds[node]]; // lands in a private copy of the page
+
+        scene.viewNodes(count, parents, subtreeEnds, at<glm::mat4>(header.localOffset), at<glm::mat4>(header.worldOffset),
+                        meshes, materialIds, flags);
+
+        const SceneLight* fileLights = at<SceneLight>(header.lightsOffset);
+        lights.assign(fileLights, fileLights + header.lightCount);
+        for (uint32_t i = 0; i < header.nameCount; ++i)
+        {
+            std::string name(names[i].name, strnlen(names[i].name, sizeof(names[i].name)));
+            scene.setName(names[i].node, name);
+        }
+        return true;
+    }
+
+    bool loadText(const std::string& path, SceneGraph& scene)
+    {
+        std::ifstream in(path.c_str());
+        std::vector<unsigned int> materialIds;
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(in, line))
+        {
+            ++lineNumber;
+            size_t comment = line.find('#');
+            if (comment != std::string::npos)
+                line.erase(comment);
+            std::istringstream words(line);
+            std::string keyword;
+            if (!(words >> keyword))
+                continue;
+
+            bool ok = true;
+            if (keyword == "scene")
+            {
+                unsigned int version = 0;
+                ok = (words >> version) && version == VERSION;
+            }
+            else if (keyword == "material")
+            {
+                Material material;
+                ok = readVec3(words, material.ambient) && readVec3(words, material.diffuse) &&
+                     readVec3(words, material.specular) && (words >> material.shininess);
+                if (ok)
+                    materialIds.push_back(scene.materials.intern(material));
+            }
+            else if (keyword == "directional" || keyword == "point")
+            {
+                SceneLight light = {};
+                light.type = keyword == "point" ? SceneLight::POINT : SceneLight::DIRECTIONAL;
+                ok = readVec3(words, light.vector) && readVec3(words, light.ambient) &&
+                     readVec3(words, light.diffuse) && readVec3(words, light.specular);
+                if (ok && light.type == SceneLight::POINT)
+                    ok = static_cast<bool>(words >> light.k_c >> light.k_l >> light.k_q);
+                if (ok)
+                    lights.push_back(light);
+            }
+            else if (keyword == "node")
+            {
+                ok = readNode(words, scene, materialIds);
+            }
+            else if (keyword == "name")
+            {
+                int node;
+                std::string name;
+                ok = (words >> node >> name) && node >= 0 && node < scene.size();
+                if (ok)
+                    scene.setName(node, name);
+            }
+            else
+            {
+                ok = false;
+            }
+
+            if (!ok)
+            {
+                std::cout << path << ":" << lineNumber << ": can't read \"" << line << "\"" << std::endl;
+                return false;
+            }
+        }
+        if (scene.size() == 0)
+        {
+            std::cout << "Scene file has no nodes: " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    static bool readNode(std::istringstream& words, SceneGraph& scene, const std::vector<unsigned int>& materialIds)
+    {
+        int parentNode;
+        std::string meshName, nodeFlags;
+        unsigned int material;
+        if (!(words >> parentNode >> meshName >> material >> nodeFlags))
+            return false;
+        if (parentNode < SceneGraph::ROOT || parentNode >= scene.size() ||
+            (parentNode != SceneGraph::ROOT && scene.subtreeEnd[parentNode] != scene.size()))
+            return false;
+        if (meshName != "none" && material >= materialIds.size())
+            return false;
+
+        glm::mat4 transform(1.0f);
+        std::string op;
+        while (words >> op)
+        {
+            glm::vec3 v;
+            if (op == "translate" && readVec3(words, v))
+            {
+                transform = glm::translate(transform, v);
+            }
+            else if (op == "scale" && readVec3(words, v))
+            {
+                transform = glm::scale(transform, v);
+            }
+            else if (op == "rotate")
+            {
+                float degrees;
+                if (!(words >> degrees) || !readVec3(words, v))
+                    return false;
+                transform = glm::rotate(transform, glm::radians(degrees), v);
+            }
+            else if (op == "matrix")
+            {
+                glm::mat4 m;
+                for (int i = 0; i < 16; ++i)
+                    if (!(words >> (&m[0][0])[i]))
+                        return false;
+                transform = transform * m;
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        int node;
+        if (meshName == "none")
+            node = scene.addNode(parentNode, transform);
+        else if (meshName == "cube")
+            node = scene.addCube(parentNode, transform, materialIds[material]);
+        else if (meshName == "sphere")
+            node = scene.addSphere(parentNode, transform, materialIds[material]);
+        else
+            return false;
+
+        for (char flag : nodeFlags)
+        {
+            if (flag == 'd')
+                scene.markDynamic(node);
+            else if (flag == 'm')
+                scene.markMerged(node, node + 1);
+            else if (flag != '-')
+                return false;
+        }
+        return true;
+    }
+
+    static bool readVec3(std::istringstream& words, glm::vec3& v)
+    {
+        return static_cast<bool>(words >> v.x >> v.y >> v.z);
+    }
+
+    static std::string number(float value)
+    {
+        char text[32];
+        snprintf(text, sizeof(text), "%.9g", value);
+        return text;
+    }
+
+    static std::string vec3Text(const glm::vec3& v)
+    {
+        return number(v.x) + " " + number(v.y) + " " + number(v.z);
+    }
+
+    // reserve a 64-byte aligned section of the given size, returning its offset
+    static uint64_t place(uint64_t& offset, size_t bytes)
+    {
+        offset = (offset + 63) & ~uint64_t(63);
+        uint64_t start = offset;
+        offset += bytes;
+        return start;
+    }
+
+    static void writeAt(std::ofstream& out, uint64_t offset, const void* data, size_t bytes)
+    {
+        static const char zeros[64] = {};
+        while (static_cast<uint64_t>(out.tellp()) < offset)
+            out.write(zeros, std::min<uint64_t>(sizeof(zeros), offset - static_cast<uint64_t>(out.tellp())));
+        if (bytes)
+            out.write(static_cast<const char*>(data), bytes);
+    }
+
+    bool fits(uint64_t offset, size_t bytes) const
+    {
+        return offset % 4 == 0 && offset <= mapping.size() && bytes <= mapping.size() - offset;
+    }
+
+    template <typename T>
+    T* at(uint64_t offset) const
+    {
+        return reinterpret_cast<T*>(mapping.data() + offset);
+    }
+};
+
+#endif
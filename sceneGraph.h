@@ -0,0 +1,253 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cassert>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "instancedRenderer.h"
+#include "materialLibrary.h"
+
+// One array of a SceneGraph. It either owns its elements (a scene built in
+// code) or views memory owned by someone else, such as a memory-mapped
+// compiled scene file, which is then used in place without any copying.
+// A view becomes an owned copy the first time it grows.
+template <typename T>
+class SceneArray
+{
+public:
+    SceneArray() {}
+    SceneArray(const SceneArray&) = delete;
+    SceneArray& operator=(const SceneArray&) = delete;
+
+    T& operator[](size_t i) { return items[i]; }
+    const T& operator[](size_t i) const { return items[i]; }
+    size_t size() const { return count; }
+    T* data() { return items; }
+    const T* data() const { return items; }
+
+    void push_back(const T& value)
+    {
+        if (viewing)
+        {
+            storage.assign(items, items + count);
+            viewing = false;
+        }
+        storage.push_back(value);
+        items = storage.data();
+        count = storage.size();
+    }
+
+    // use count elements at external, which must outlive this array (or the next push_back)
+    void view(T* external, size_t elements)
+    {
+        storage.clear();
+        storage.shrink_to_fit();
+        items = external;
+        count = elements;
+        viewing = true;
+    }
+
+private:
+    std::vector<T> storage;
+    T* items = nullptr;
+    size_t count = 0;
+    bool viewing = false;
+};
+
+// Transform hierarchy stored as parallel arrays (structure of arrays).
+// Nodes are appended depth-first, so parents always come before their
+// children and every subtree occupies the contiguous range [i, subtreeEnd[i]).
+// Changing a local transform only queues that node; updateWorld() then
+// recomputes world matrices for the queued subtrees and nothing else.
+class SceneGraph
+{
+public:
+    static const int ROOT = -1;
+
+    // hierarchy
+    SceneArray<int> parent;
+    SceneArray<int> subtreeEnd;
+    // transforms
+    SceneArray<glm::mat4> local;
+    SceneArray<glm::mat4> world;
+    // drawable mesh and its material, an id into materials (ignored unless the node is drawable)
+    SceneArray<unsigned char> mesh;
+    SceneArray<unsigned int> material;
+    SceneArray<unsigned char> flags;
+
+    MaterialLibrary materials;
+
+    enum NodeFlags : unsigned char
+    {
+        DRAWABLE = 1 << 0,
+        DYNAMIC = 1 << 1,
+        MERGED = 1 << 2 // baked into the merged static geometry
+    };
+
+    // meshes fill the unit cube [-0.5, 0.5]^3 before the node's transform
+    enum Mesh : unsigned char
+    {
+        CUBE,
+        SPHERE
+    };
+
+    // add a transform-only node. The parent's subtree must still be open,
+    // i.e. no node outside it has been appended since.
+    int addNode(int parentNode, const glm::mat4& localTransform)
+    {
+        int node = static_cast<int>(local.size());
+        assert(parentNode == ROOT || subtreeEnd[parentNode] == node);
+        ++layoutVersion;
+
+        parent.push_back(parentNode);
+        subtreeEnd.push_back(node + 1);
+        local.push_back(localTransform);
+        world.push_back(parentNode == ROOT ? localTransform : world[parentNode] * localTransform);
+        mesh.push_back(CUBE);
+        material.push_back(0);
+        flags.push_back(parentNode != ROOT ? (flags[parentNode] & DYNAMIC) : 0);
+
+        // every ancestor's range now extends over the new node
+        for (int ancestor = parentNode; ancestor != ROOT; ancestor = parent[ancestor])
+            subtreeEnd[ancestor] = node + 1;
+        return node;
+    }
+
+    // add a node that draws the unit cube with the given material
+    int addCube(int parentNode, const glm::mat4& localTransform, unsigned int cubeMaterial)
+    {
+        int node = addNode(parentNode, localTransform);
+        material[node] = cubeMaterial;
+        flags[node] |= DRAWABLE;
+        return node;
+    }
+
+    // add a node that draws the sphere inscribed in the unit cube
+    int addSphere(int parentNode, const glm::mat4& localTransform, unsigned int sphereMaterial)
+    {
+        int node = addCube(parentNode, localTransform, sphereMaterial);
+        mesh[node] = SPHERE;
+        return node;
+    }
+
+    // flag a subtree as animated so it is left out of the static bake.
+    // Children added afterwards inherit the flag.
+    void markDynamic(int node)
+    {
+        for (int i = node; i < subtreeEnd[node]; ++i)
+            flags[i] = static_cast<unsigned char>((flags[i] | DYNAMIC) & ~MERGED);
+        ++layoutVersion;
+    }
+
+    // bake the static cubes among nodes [first, last) into the merged
+    // geometry instead of drawing them as instances
+    void markMerged(int first, int last)
+    {
+        for (int i = first; i < last; ++i)
+            if ((flags[i] & (DRAWABLE | DYNAMIC)) == DRAWABLE && mesh[i] == CUBE)
+                flags[i] |= MERGED;
+        ++layoutVersion;
+    }
+
+    void setLocal(int node, const glm::mat4& localTransform)
+    {
+        local[node] = localTransform;
+        dirtyRoots.push_back(node);
+        if (!(flags[node] & DYNAMIC))
+            ++layoutVersion;
+    }
+
+    // give a node a name that survives saving and loading the scene
+    void setName(int node, const std::string& name)
+    {
+        names.push_back(std::make_pair(name, node));
+    }
+
+    // every node with the given name, in the order they were named
+    std::vector<int> findAll(const std::string& name) const
+    {
+        std::vector<int> nodes;
+        for (const std::pair<std::string, int>& entry : names)
+            if (entry.first == name)
+                nodes.push_back(entry.second);
+        return nodes;
+    }
+
+    const std::vector<std::pair<std::string, int> >& namedNodes() const
+    {
+        return names;
+    }
+
+    // replace every node with count nodes whose arrays live elsewhere (see
+    // SceneFile); world must already hold the world matrices
+    void viewNodes(size_t count, int* parents, int* subtreeEnds, glm::mat4* locals, glm::mat4* worlds,
+                   unsigned char* meshes, unsigned int* materialIds, unsigned char* nodeFlags)
+    {
+        parent.view(parents, count);
+        subtreeEnd.view(subtreeEnds, count);
+        local.view(locals, count);
+        world.view(worlds, count);
+        mesh.view(meshes, count);
+        material.view(materialIds, count);
+        flags.view(nodeFlags, count);
+        dirtyRoots.clear();
+        ++layoutVersion;
+    }
+
+    // changes whenever nodes are added or something static moves, i.e.
+    // whenever geometry baked from the static nodes goes stale
+    unsigned int staticLayoutVersion() const
+    {
+        return layoutVersion;
+    }
+
+    // recompute world matrices of every subtree whose root changed since the
+    // last call; returns the number of nodes touched
+    int updateWorld()
+    {
+        if (dirtyRoots.empty())
+            return 0;
+
+        // depth-first order means a nested dirty root has a larger index than
+        // its dirty ancestor and lies inside that ancestor's range
+        std::sort(dirtyRoots.begin(), dirtyRoots.end());
+        int touched = 0;
+        int coveredUntil = 0;
+        for (int root : dirtyRoots)
+        {
+            if (root < coveredUntil)
+                continue;
+            for (int i = root; i < subtreeEnd[root]; ++i)
+            {
+                int p = parent[i];
+                world[i] = p == ROOT ? local[i] : world[p] * local[i];
+            }
+            touched += subtreeEnd[root] - root;
+            coveredUntil = subtreeEnd[root];
+        }
+        dirtyRoots.clear();
+        return touched;
+    }
+
+    // per-instance attributes of a drawable node at its current world transform
+    InstanceData instance(int node) const
+    {
+        return InstancedRenderer::makeInstance(world[node], material[node]);
+    }
+
+    int size() const
+    {
+        return static_cast<int>(local.size());
+    }
+
+private:
+    std::vector<int> dirtyRoots;
+    std::vector<std::pair<std::string, int> > names;
+    unsigned int layoutVersion = 0;
+};
+
+#endif
@@ -4,18 +4,32 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <chrono>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+
+#include "programCache.h"
+
+// typed handle to a uniform location, resolved once after linking so the
+// render loop never has to look a uniform up by name
+template <typename T>
+struct Uniform
+{
+    GLint location = -1;
+    bool isValid() const { return location >= 0; }
+};
 
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor generates the shader on the fly; defines (lines of
+    // "#define NAME value") are inserted after the #version line of every stage
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const std::string& defines = "")
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
@@ -57,44 +71,37 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char* fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
-        if (geometryPath != nullptr)
+        if (!defines.empty())
         {
-            const char* gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
+            vertexCode = injectDefines(vertexCode, defines);
+            fragmentCode = injectDefines(fragmentCode, defines);
+            if (geometryPath != nullptr)
+                geometryCode = injectDefines(geometryCode, defines);
         }
-        // shader Program
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        ProgramCache& cache = ProgramCache::get();
+        uint64_t cacheKey = cache.key({ vertexCode, fragmentCode, geometryCode });
         ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if (geometryPath != nullptr)
-            glAttachShader(ID, geometry);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if (geometryPath != nullptr)
-            glDeleteShader(geometry);
+        if (cache.load(ID, cacheKey))
+        {
+            ++cache.stats.hits;
+        }
+        else
+        {
+            buildFromSource(vertexCode, fragmentCode, geometryPath != nullptr ? &geometryCode : nullptr);
+            cache.store(ID, cacheKey);
+            ++cache.stats.misses;
+        }
+        cache.stats.milliseconds += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
 
+        reflectUniforms();
+    }
+    // adopt a program that is already linked (see ShaderBuilder)
+    // ------------------------------------------------------------------------
+    explicit Shader(GLuint linkedProgram)
+        : ID(linkedProgram)
+    {
+        reflectUniforms();
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -102,66 +109,221 @@ public:
     {
         glUseProgram(ID);
     }
-    // utility uniform functions
+    // resolve a uniform handle from the reflected location table
+    // ------------------------------------------------------------------------
+    template <typename T>
+    Uniform<T> uniform(const std::string& name) const
+    {
+        Uniform<T> handle;
+        handle.location = location(name);
+        return handle;
+    }
+    // attach a uniform block to a buffer binding point; a no-op if the block is inactive
+    // ------------------------------------------------------------------------
+    void bindUniformBlock(const std::string& blockName, GLuint bindingPoint) const
+    {
+        GLuint index = glGetUniformBlockIndex(ID, blockName.c_str());
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, bindingPoint);
+    }
+    // typed uniform setters, no string lookup involved
+    // ------------------------------------------------------------------------
+    void set(Uniform<bool> u, bool value) const { glUniform1i(u.location, (int)value); }
+    void set(Uniform<int> u, int value) const { glUniform1i(u.location, value); }
+    void set(Uniform<float> u, float value) const { glUniform1f(u.location, value); }
+    void set(Uniform<glm::ivec3> u, const glm::ivec3& value) const { glUniform3i(u.location, value.x, value.y, value.z); }
+    void set(Uniform<glm::vec2> u, const glm::vec2& value) const { glUniform2fv(u.location, 1, &value[0]); }
+    void set(Uniform<glm::vec3> u, const glm::vec3& value) const { glUniform3fv(u.location, 1, &value[0]); }
+    void set(Uniform<glm::vec4> u, const glm::vec4& value) const { glUniform4fv(u.location, 1, &value[0]); }
+    void set(Uniform<glm::mat2> u, const glm::mat2& mat) const { glUniformMatrix2fv(u.location, 1, GL_FALSE, &mat[0][0]); }
+    void set(Uniform<glm::mat3> u, const glm::mat3& mat) const { glUniformMatrix3fv(u.location, 1, GL_FALSE, &mat[0][0]); }
+    void set(Uniform<glm::mat4> u, const glm::mat4& mat) const { glUniformMatrix4fv(u.location, 1, GL_FALSE, &mat[0][0]); }
+    // utility uniform functions (by name: each call counts as a string lookup)
     // ------------------------------------------------------------------------
     void setBool(const std::string& name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        glUniform1i(location(name), (int)value);
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string& name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(location(name), value);
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string& name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1f(location(name), value);
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string& name, const glm::vec2& value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2fv(location(name), 1, &value[0]);
     }
     void setVec2(const std::string& name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(location(name), x, y);
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string& name, const glm::vec3& value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform3fv(location(name), 1, &value[0]);
     }
     void setVec3(const std::string& name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(location(name), x, y, z);
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string& name, const glm::vec4& value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform4fv(location(name), 1, &value[0]);
     }
     void setVec4(const std::string& name, float x, float y, float z, float w)
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4f(location(name), x, y, z, w);
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string& name, const glm::mat2& mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string& name, const glm::mat3& mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string& name, const glm::mat4& mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
+    }
+    // insert defines after the #version line, which must stay first
+    // ------------------------------------------------------------------------
+    static std::string injectDefines(const std::string& code, const std::string& defines)
+    {
+        size_t version = code.find("#version");
+        size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return defines + code;
+        return code.substr(0, lineEnd + 1) + defines + code.substr(lineEnd + 1);
+    }
+    // whole contents of a shader file, or an empty string (and a message) if it can't be read
+    // ------------------------------------------------------------------------
+    static std::string readFile(const std::string& path)
+    {
+        std::ifstream file(path.c_str());
+        if (!file)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+            return std::string();
+        }
+        std::stringstream stream;
+        stream << file.rdbuf();
+        return stream.str();
+    }
+    // string-based uniform lookups since the last beginFrame(), across all shaders
+    // ------------------------------------------------------------------------
+    static void beginFrame()
+    {
+        stringLookupCounter() = 0;
+    }
+    static unsigned int stringLookupsThisFrame()
+    {
+        return stringLookupCounter();
     }
 
 private:
+    std::unordered_map<std::string, GLint> uniformLocations;
+
+    static unsigned int& stringLookupCounter()
+    {
+        static unsigned int count = 0;
+        return count;
+    }
+    // look a uniform up in the reflected table; -1 (ignored by glUniform*) if inactive
+    // ------------------------------------------------------------------------
+    GLint location(const std::string& name) const
+    {
+        ++stringLookupCounter();
+        auto it = uniformLocations.find(name);
+        return it != uniformLocations.end() ? it->second : -1;
+    }
+    // query every active uniform once after linking and build the location table.
+    // arrays are registered both by their base name and per element.
+    // ------------------------------------------------------------------------
+    void reflectUniforms()
+    {
+        uniformLocations.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::string name(maxLength > 0 ? maxLength : 1, '\0');
+        for (GLint i = 0; i < count; ++i)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, (GLuint)i, maxLength, &length, &size, &type, &name[0]);
+            std::string uniformName(name.c_str(), length);
+            GLint loc = glGetUniformLocation(ID, uniformName.c_str());
+            if (loc < 0)
+                continue; // uniform block members have no location
+            uniformLocations[uniformName] = loc;
+
+            const std::string suffix = "[0]";
+            if (uniformName.size() > suffix.size() && uniformName.compare(uniformName.size() - suffix.size(), suffix.size(), suffix) == 0)
+            {
+                std::string base = uniformName.substr(0, uniformName.size() - suffix.size());
+                uniformLocations[base] = loc;
+                for (GLint e = 1; e < size; ++e)
+                {
+                    std::string element = base + "[" + std::to_string(e) + "]";
+                    uniformLocations[element] = glGetUniformLocation(ID, element.c_str());
+                }
+            }
+        }
+    }
+    // compile and link the program from source into ID
+    // ------------------------------------------------------------------------
+    void buildFromSource(const std::string& vertexCode, const std::string& fragmentCode, const std::string* geometryCode)
+    {
+        const char* vShaderCode = vertexCode.c_str();
+        const char* fShaderCode = fragmentCode.c_str();
+        // 2. compile shaders
+        unsigned int vertex, fragment;
+        // vertex shader
+        vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glCompileShader(vertex);
+        checkCompileErrors(vertex, "VERTEX");
+        // fragment Shader
+        fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glCompileShader(fragment);
+        checkCompileErrors(fragment, "FRAGMENT");
+        // if geometry shader is given, compile geometry shader
+        unsigned int geometry = 0;
+        if (geometryCode != nullptr)
+        {
+            const char* gShaderCode = geometryCode->c_str();
+            geometry = glCreateShader(GL_GEOMETRY_SHADER);
+            glShaderSource(geometry, 1, &gShaderCode, NULL);
+            glCompileShader(geometry);
+            checkCompileErrors(geometry, "GEOMETRY");
+        }
+        // shader Program; ID already exists, left unlinked if a cached binary was rejected
+        ProgramCache::get().prepare(ID);
+        glAttachShader(ID, vertex);
+        glAttachShader(ID, fragment);
+        if (geometryCode != nullptr)
+            glAttachShader(ID, geometry);
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM");
+        // delete the shaders as they're linked into our program now and no longer necessary
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        if (geometryCode != nullptr)
+            glDeleteShader(geometry);
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
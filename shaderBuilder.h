@@ -0,0 +1,210 @@
+#ifndef SHADER_BUILDER_H
+#define SHADER_BUILDER_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "glExtensions.h"
+#include "programCache.h"
+
+// Builds shader programs without stalling the frame. With
+// KHR_parallel_shader_compile the driver compiles and links on its own
+// threads and each job is polled with GL_COMPLETION_STATUS_KHR. Without it,
+// jobs go to a worker thread that owns a hidden context sharing objects with
+// the main one. With neither, start() builds on the spot. Finished programs
+// go through the program cache like any other.
+class ShaderBuilder
+{
+public:
+    struct Job
+    {
+        GLuint program = 0; // once finished: linked, or 0 if the build failed
+        uint64_t cacheKey = 0;
+        std::string vertexCode, fragmentCode;
+        GLuint vertex = 0, fragment = 0;
+        bool finished = false;
+        std::atomic<bool> workerDone{ false };
+    };
+
+    // workerContext: a hidden window sharing the main context, used when the
+    // driver can't compile in parallel; may be NULL
+    explicit ShaderBuilder(GLFWwindow* workerContext = NULL)
+    {
+        GLExtensions& gl = GLExtensions::get();
+        if (gl.parallelShaderCompile)
+        {
+            mode = PARALLEL;
+            gl.maxShaderCompilerThreads(0xFFFFFFFFu); // as many as the driver likes
+        }
+        else if (workerContext)
+        {
+            mode = WORKER;
+            worker = std::thread(&ShaderBuilder::workerLoop, this, workerContext);
+        }
+    }
+
+    ~ShaderBuilder()
+    {
+        if (worker.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_one();
+            worker.join();
+        }
+    }
+
+    ShaderBuilder(const ShaderBuilder&) = delete;
+    ShaderBuilder& operator=(const ShaderBuilder&) = delete;
+
+    const char* modeName() const
+    {
+        return mode == PARALLEL ? "parallel compile" : (mode == WORKER ? "worker context" : "blocking");
+    }
+
+    std::shared_ptr<Job> start(const std::string& vertexCode, const std::string& fragmentCode)
+    {
+        std::shared_ptr<Job> job(new Job());
+        job->vertexCode = vertexCode;
+        job->fragmentCode = fragmentCode;
+        job->cacheKey = ProgramCache::get().key({ vertexCode, fragmentCode, std::string() });
+        if (mode == WORKER)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                queue.push_back(job);
+            }
+            wake.notify_one();
+            return job;
+        }
+        build(*job);
+        if (mode == BLOCKING)
+        {
+            finish(*job);
+            job->finished = true;
+        }
+        return job;
+    }
+
+    // true once the job is over; never blocks
+    bool poll(Job& job)
+    {
+        if (job.finished)
+            return true;
+        if (mode == WORKER)
+            return job.finished = job.workerDone.load(std::memory_order_acquire);
+        if (job.vertex)
+        {
+            GLint complete = GL_FALSE;
+            glGetProgramiv(job.program, GL_COMPLETION_STATUS_KHR, &complete);
+            if (!complete)
+                return false;
+        }
+        finish(job);
+        job.finished = true;
+        return true;
+    }
+
+private:
+    enum Mode { BLOCKING, PARALLEL, WORKER };
+    Mode mode = BLOCKING;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::shared_ptr<Job> > queue;
+    bool stopping = false;
+
+    // create the program and kick off compiling and linking; with parallel
+    // compile nothing here waits for the driver
+    void build(Job& job)
+    {
+        job.program = glCreateProgram();
+        if (ProgramCache::get().load(job.program, job.cacheKey))
+            return;
+        const char* vertexSource = job.vertexCode.c_str();
+        const char* fragmentSource = job.fragmentCode.c_str();
+        job.vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(job.vertex, 1, &vertexSource, NULL);
+        glCompileShader(job.vertex);
+        job.fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(job.fragment, 1, &fragmentSource, NULL);
+        glCompileShader(job.fragment);
+        ProgramCache::get().prepare(job.program);
+        glAttachShader(job.program, job.vertex);
+        glAttachShader(job.program, job.fragment);
+        glLinkProgram(job.program);
+    }
+
+    // collect the result of a completed build
+    void finish(Job& job)
+    {
+        if (!job.vertex)
+            return; // linked from the program cache
+        GLint linked = GL_FALSE;
+        glGetProgramiv(job.program, GL_LINK_STATUS, &linked);
+        if (linked)
+        {
+            ProgramCache::get().store(job.program, job.cacheKey);
+        }
+        else
+        {
+            printLog(job.vertex, "VERTEX");
+            printLog(job.fragment, "FRAGMENT");
+            GLchar infoLog[1024];
+            glGetProgramInfoLog(job.program, sizeof(infoLog), NULL, infoLog);
+            std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: PROGRAM\n" << infoLog << std::endl;
+            glDeleteProgram(job.program);
+            job.program = 0;
+        }
+        glDeleteShader(job.vertex);
+        glDeleteShader(job.fragment);
+        job.vertex = job.fragment = 0;
+    }
+
+    static void printLog(GLuint shader, const char* type)
+    {
+        GLint compiled = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+        if (compiled)
+            return;
+        GLchar infoLog[1024];
+        glGetShaderInfoLog(shader, sizeof(infoLog), NULL, infoLog);
+        std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << std::endl;
+    }
+
+    void workerLoop(GLFWwindow* context)
+    {
+        glfwMakeContextCurrent(context);
+        for (;;)
+        {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (stopping)
+                    break;
+                job = queue.front();
+                queue.pop_front();
+            }
+            build(*job);
+            finish(*job);
+            glFinish(); // the program must be complete before the main context uses it
+            job->workerDone.store(true, std::memory_order_release);
+        }
+        glfwMakeContextCurrent(NULL);
+    }
+};
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "shader.h"
+#include "shaderBuilder.h"
+
+// Compile-time specializations of one shader. Each feature is a bit of the
+// variant key and is injected as "#define NAME 0" or "#define NAME 1" after
+// the #version line, so a variant without a feature carries none of its code.
+// Linked variants are kept in a small cache keyed by those bits, least
+// recently used first out; rebuilding an evicted one is cheap with the
+// program cache. Uniforms is resolved per variant through
+// Uniforms::resolve(const Shader&), since locations differ between programs.
+// reload() rebuilds every cached variant from the current sources in the
+// background; each keeps rendering with its old program until update() finds
+// the new one linked, and a build that fails leaves the old one in place.
+template <typename Uniforms>
+class ShaderVariants
+{
+public:
+    struct Variant
+    {
+        unsigned int key;
+        std::unique_ptr<Shader> shader;
+        Uniforms uniforms;
+        unsigned long long lastUsed;
+        std::shared_ptr<ShaderBuilder::Job> pending; // reload in flight
+    };
+
+    ShaderVariants(const std::string& vertexPath, const std::string& fragmentPath, const std::vector<std::string>& features, size_t capacity = 8)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), features(features), capacity(capacity)
+    {
+    }
+
+    ShaderVariants(const ShaderVariants&) = delete;
+    ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+    // the variant with the given feature bits, linked on first use
+    Variant& get(unsigned int key)
+    {
+        ++useCounter;
+        for (std::unique_ptr<Variant>& variant : variants)
+        {
+            if (variant->key == key)
+            {
+                variant->lastUsed = useCounter;
+                return *variant;
+            }
+        }
+
+        if (variants.size() >= capacity)
+        {
+            size_t oldest = 0;
+            for (size_t i = 1; i < variants.size(); ++i)
+                if (variants[i]->lastUsed < variants[oldest]->lastUsed)
+                    oldest = i;
+            if (variants[oldest]->pending)
+                abandoned.push_back(variants[oldest]->pending);
+            variants.erase(variants.begin() + oldest);
+        }
+        std::unique_ptr<Variant> variant(new Variant());
+        variant->key = key;
+        variant->shader.reset(new Shader(vertexPath.c_str(), fragmentPath.c_str(), nullptr, defines(key)));
+        variant->uniforms.resolve(*variant->shader);
+        variant->lastUsed = useCounter;
+        variants.push_back(std::move(variant));
+        return *variants.back();
+    }
+
+    // start rebuilding every cached variant from the files on disk
+    void reload(ShaderBuilder& builder)
+    {
+        std::string vertexCode = Shader::readFile(vertexPath);
+        std::string fragmentCode = Shader::readFile(fragmentPath);
+        if (vertexCode.empty() || fragmentCode.empty())
+            return; // probably caught mid-save; the next change event retries
+        for (std::unique_ptr<Variant>& variant : variants)
+        {
+            if (variant->pending)
+                abandoned.push_back(variant->pending);
+            std::string text = defines(variant->key);
+            variant->pending = builder.start(Shader::injectDefines(vertexCode, text), Shader::injectDefines(fragmentCode, text));
+        }
+    }
+
+    // swap in reloaded programs that finished linking; true if any variant
+    // changed program, after which cached Variant references must re-resolve
+    bool update(ShaderBuilder& builder)
+    {
+        bool swapped = false;
+        for (std::unique_ptr<Variant>& variant : variants)
+        {
+            if (!variant->pending || !builder.poll(*variant->pending))
+                continue;
+            GLuint program = variant->pending->program;
+            variant->pending.reset();
+            if (!program)
+            {
+                std::cout << "Shader reload failed, keeping the previous program" << std::endl;
+                continue;
+            }
+            glDeleteProgram(variant->shader->ID);
+            variant->shader.reset(new Shader(program));
+            variant->uniforms = Uniforms();
+            variant->uniforms.resolve(*variant->shader);
+            swapped = true;
+        }
+        for (size_t i = 0; i < abandoned.size();)
+        {
+            if (builder.poll(*abandoned[i]))
+            {
+                if (abandoned[i]->program)
+                    glDeleteProgram(abandoned[i]->program);
+                abandoned.erase(abandoned.begin() + i);
+            }
+            else
+            {
+                ++i;
+            }
+        }
+        return swapped;
+    }
+
+    // the #define lines of a key, e.g. for logging
+    std::string defines(unsigned int key) const
+    {
+        std::string text;
+        for (size_t i = 0; i < features.size(); ++i)
+            text += "#define " + features[i] + ((key >> i) & 1u ? " 1\n" : " 0\n");
+        return text;
+    }
+
+    // number of linked variants currently cached
+    size_t size() const
+    {
+        return variants.size();
+    }
+
+private:
+    std::string vertexPath, fragmentPath;
+    std::vector<std::string> features;
+    size_t capacity;
+    std::vector<std::unique_ptr<Variant> > variants;
+    std::vector<std::shared_ptr<ShaderBuilder::Job> > abandoned;
+    unsigned long long useCounter = 0;
+};
+
+#endif
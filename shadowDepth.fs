@@ -0,0 +1,16 @@
+#version 330 core
+
+in vec3 WorldPos;
+
+// xyz = point light position, w = far plane of its cube map;
+// w = 0 for the directional light's map
+uniform vec4 lightPosition;
+
+void main()
+{
+    // cube maps store the distance to the light, so the lookup needs no face projection
+    if (lightPosition.w > 0.0)
+        gl_FragDepth = length(WorldPos - lightPosition.xyz) / lightPosition.w;
+    else
+        gl_FragDepth = gl_FragCoord.z;
+}
@@ -0,0 +1,16 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+// shadow casters are always drawn instanced, with the same per-instance
+// attributes as vertexShaderForPhongShading.vs
+layout (location = 2) in mat4 aInstanceModel;
+
+out vec3 WorldPos;
+
+uniform mat4 lightSpace; // projection * view of the shadow map, or of one cube map face
+
+void main()
+{
+    vec4 worldPos = aInstanceModel * vec4(aPos, 1.0);
+    WorldPos = vec3(worldPos);
+    gl_Position = lightSpace * worldPos;
+}
@@ -0,0 +1,465 @@
+#ifndef SHADOW_MAPS_H
+#define SHADOW_MAPS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bvh.h"
+#include "directionalLight.h"
+#include "instancedRenderer.h"
+#include "mergedGeometry.h"
+#include "pointLight.h"
+#include "sceneGraph.h"
+#include "shader.h"
+#include "sphere.h"
+
+// Shadow maps for the directional light and the first MAX_POINT_LIGHTS point
+// lights: a cube map around each of those point lights that stores the
+// distance to the light, and one orthographic depth map over the scene for
+// the directional light. Every map is kept twice. The static copy holds the
+// depth of everything that doesn't move and is only rendered again when the
+// static layout or the light's position changes. Each frame, the faces a
+// dynamic caster (a fan blade) touches now or touched last frame are copied
+// from the static copy into the frame copy, and the dynamic casters are
+// drawn over them; the shader samples the frame copy. The cost per frame
+// thus follows what moves, not how much furniture the room holds. Maps of
+// lights that are off are not touched. Static casters within FIXTURE_RADIUS
+// of a point light are its housing (lamp cube, pendant, bulb) and cast no
+// shadow from it.
+class ShadowMaps
+{
+public:
+    static const int MAX_POINT_LIGHTS = 4;
+    static const GLuint FIRST_POINT_UNIT = 4; // texture units of pointShadowMaps[0..3]
+    static const GLuint DIRECTIONAL_UNIT = 8; // texture unit of directionalShadowMap
+    static const int CUBE_SIZE = 512;
+    static const int DIRECTIONAL_SIZE = 2048;
+    static constexpr float FIXTURE_RADIUS = 0.5f;
+    static constexpr float CUBE_NEAR = 0.05f;
+
+    struct Stats
+    {
+        unsigned long long staticRenders = 0;   // maps whose static copy was rendered
+        unsigned long long compositedFaces = 0; // map faces the dynamic casters were drawn into
+    };
+
+    ShadowMaps(const MeshBuffer& cube, const SphereLODs& spheres)
+        : depthShader("shadowDepth.vs", "shadowDepth.fs")
+    {
+        lightSpaceUniform = depthShader.uniform<glm::mat4>("lightSpace");
+        lightPositionUniform = depthShader.uniform<glm::vec4>("lightPosition");
+
+        const SphereLODs::Level& sphere = spheres.levels[SPHERE_LEVEL];
+        for (int dynamic = 0; dynamic < 2; ++dynamic)
+        {
+            std::unique_ptr<InstancedRenderer>* batches = dynamic ? dynamicCasters : staticCasters;
+            batches[0].reset(new InstancedRenderer(cube));
+            batches[1].reset(new InstancedRenderer(spheres.mesh, sphere.indexCount, sphere.firstIndex));
+        }
+
+        // depth only; the offscreen target of a headless run stays bound
+        GLint bound = 0;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &bound);
+        glGenFramebuffers(1, &drawFramebuffer);
+        glGenFramebuffers(1, &readFramebuffer);
+        for (GLuint framebuffer : { drawFramebuffer, readFramebuffer })
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, bound);
+    }
+
+    ~ShadowMaps()
+    {
+        for (Map& map : pointMaps)
+            map.release();
+        directionalMap.release();
+        glDeleteFramebuffers(1, &drawFramebuffer);
+        glDeleteFramebuffers(1, &readFramebuffer);
+    }
+
+    ShadowMaps(const ShadowMaps&) = delete;
+    ShadowMaps& operator=(const ShadowMaps&) = delete;
+
+    // point lights that get a cube map: the first ones of the scene's list
+    static size_t shadowedPointLights(size_t pointLightCount)
+    {
+        return std::min(pointLightCount, static_cast<size_t>(MAX_POINT_LIGHTS));
+    }
+
+    void resolveUniforms(const Shader& shader)
+    {
+        shadowedPointLightsUniform = shader.uniform<int>("shadowedPointLights");
+        pointShadowFarUniform = shader.uniform<glm::vec4>("pointShadowFar");
+        pointShadowBiasUniform = shader.uniform<float>("pointShadowBias");
+        directionalShadowMatrixUniform = shader.uniform<glm::mat4>("directionalShadowMatrix");
+        directionalShadowTexelUniform = shader.uniform<float>("directionalShadowTexel");
+    }
+
+    // bring every map of a light that is on up to date; call after
+    // SceneGraph::updateWorld() and MergedGeometry::update(). Restores the
+    // framebuffers and viewport, but leaves the depth program bound.
+    void update(const SceneGraph& scene, MergedGeometry& shell, const DirectionalLight& directional, const std::vector<PointLight*>& pointLights)
+    {
+        if (!listed || listedVersion != scene.staticLayoutVersion())
+            listCasters(scene);
+        GLint drawBinding = 0, readBinding = 0, viewport[4];
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawBinding);
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readBinding);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+
+        dynamicBoxes.clear();
+        for (int mesh = 0; mesh < MESHES; ++mesh)
+        {
+            dynamicCasters[mesh]->begin();
+            for (int node : dynamicNodes[mesh])
+            {
+                dynamicCasters[mesh]->add(scene.instance(node));
+                dynamicBoxes.push_back(AABB::fromUnitCube(scene.world[node]));
+            }
+        }
+        dynamicUploaded = false;
+
+        depthShader.use();
+        size_t shadowed = shadowedPointLights(pointLights.size());
+        for (size_t i = 0; i < shadowed; ++i)
+        {
+            const PointLight& light = *pointLights[i];
+            if (light.range() <= 0.0f)
+                continue;
+            Map& map = pointMaps[i];
+            if (!map.built || map.builtVersion != scene.staticLayoutVersion() || map.builtFor != light.position)
+            {
+                placePointMap(map, light.position);
+                renderStatic(scene, shell, map, &light.position);
+                map.builtFor = light.position;
+            }
+            map.builtVersion = scene.staticLayoutVersion();
+            composite(map);
+        }
+
+        if (directional.effectiveDiffuse() != glm::vec3(0.0f) || directional.effectiveSpecular() != glm::vec3(0.0f))
+        {
+            Map& map = directionalMap;
+            if (!map.built || map.builtVersion != scene.staticLayoutVersion() || map.builtFor != directional.direction)
+            {
+                placeDirectionalMap(map, directional.direction);
+                renderStatic(scene, shell, map, nullptr);
+                map.builtFor = directional.direction;
+            }
+            map.builtVersion = scene.staticLayoutVersion();
+            composite(map);
+        }
+
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawBinding);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, readBinding);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    // bind the frame copies and set the per-frame uniforms; the shader must be bound
+    void apply(const Shader& shader, size_t pointLightCount) const
+    {
+        glm::vec4 shadowFar(1.0f);
+        for (int i = 0; i < MAX_POINT_LIGHTS; ++i)
+        {
+            glActiveTexture(GL_TEXTURE0 + FIRST_POINT_UNIT + i);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, pointMaps[i].frameDepth);
+            shadowFar[i] = pointMaps[i].farPlane;
+        }
+        glActiveTexture(GL_TEXTURE0 + DIRECTIONAL_UNIT);
+        glBindTexture(GL_TEXTURE_2D, directionalMap.frameDepth);
+        glActiveTexture(GL_TEXTURE0);
+
+        shader.set(shadowedPointLightsUniform, static_cast<int>(shadowedPointLights(pointLightCount)));
+        shader.set(pointShadowFarUniform, shadowFar);
+        // two texels of a cube face per unit of distance from the light
+        shader.set(pointShadowBiasUniform, 4.0f / CUBE_SIZE);
+        shader.set(directionalShadowMatrixUniform, directionalMap.shadowMatrix);
+        shader.set(directionalShadowTexelUniform, directionalMap.texel);
+    }
+
+    const Stats& stats() const
+    {
+        return totals;
+    }
+
+private:
+    // one shadow map, a cube map or a single 2D map
+    struct Map
+    {
+        GLuint staticDepth = 0, frameDepth = 0;
+        int faces = 0, size = 0;
+        glm::mat4 faceMatrices[6];  // light projection * view per face
+        Frustum frustums[6];
+        float farPlane = 1.0f;      // cube maps: distance stored as depth 1
+        glm::vec4 lightPosition;    // for shadowDepth.fs
+        glm::mat4 shadowMatrix;     // 2D maps: world to texture coordinates and depth
+        float texel = 0.0f;         // 2D maps: texel size in world units
+        bool built = false;
+        unsigned int builtVersion = 0;
+        glm::vec3 builtFor;         // light position or direction
+        unsigned int lastTouched = 0; // faces the dynamic casters were drawn into last frame
+        unsigned int stale = 0;       // faces whose frame copy still lacks the static depth
+
+        void release()
+        {
+            glDeleteTextures(1, &staticDepth);
+            glDeleteTextures(1, &frameDepth);
+            staticDepth = frameDepth = 0;
+        }
+    };
+
+    static const int MESHES = 2;       // cube and sphere
+    static const int SPHERE_LEVEL = 1; // level of detail of sphere casters
+
+    Shader depthShader;
+    Uniform<glm::mat4> lightSpaceUniform;
+    Uniform<glm::vec4> lightPositionUniform;
+    Uniform<int> shadowedPointLightsUniform;
+    Uniform<glm::vec4> pointShadowFarUniform;
+    Uniform<float> pointShadowBiasUniform;
+    Uniform<glm::mat4> directionalShadowMatrixUniform;
+    Uniform<float> directionalShadowTexelUniform;
+
+    GLuint drawFramebuffer = 0, readFramebuffer = 0;
+    Map pointMaps[MAX_POINT_LIGHTS];
+    Map directionalMap;
+    std::unique_ptr<InstancedRenderer> staticCasters[MESHES], dynamicCasters[MESHES];
+    bool dynamicUploaded = false;
+
+    // casters by kind, refreshed whenever the static layout changes
+    std::vector<int> mergedNodes, staticNodes[MESHES], dynamicNodes[MESHES];
+    AABB staticBounds;
+    bool listed = false;
+    unsigned int listedVersion = 0;
+    std::vector<int> mergedCasters; // the merged nodes drawn into the current map
+    std::vector<AABB> dynamicBoxes;
+    Stats totals;
+
+    void listCasters(const SceneGraph& scene)
+    {
+        mergedNodes.clear();
+        staticBounds = AABB();
+        for (int mesh = 0; mesh < MESHES; ++mesh)
+        {
+            staticNodes[mesh].clear();
+            dynamicNodes[mesh].clear();
+        }
+        for (int node = 0; node < scene.size(); ++node)
+        {
+            unsigned char flags = scene.flags[node];
+            if (!(flags & SceneGraph::DRAWABLE))
+                continue;
+            int mesh = scene.mesh[node] == SceneGraph::SPHERE ? 1 : 0;
+            if (flags & SceneGraph::DYNAMIC)
+            {
+                dynamicNodes[mesh].push_back(node);
+                continue;
+            }
+            (flags & SceneGraph::MERGED ? mergedNodes : staticNodes[mesh]).push_back(node);
+            staticBounds.grow(AABB::fromUnitCube(scene.world[node]));
+        }
+        listedVersion = scene.staticLayoutVersion();
+        listed = true;
+    }
+
+    void allocate(Map& map, int faces, int size)
+    {
+        if (map.faces == faces)
+            return;
+        map.release();
+        map.faces = faces;
+        map.size = size;
+        GLenum target = faces == 6 ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+        for (GLuint* texture : { &map.staticDepth, &map.frameDepth })
+        {
+            glGenTextures(1, texture);
+            glBindTexture(target, *texture);
+            for (int face = 0; face < faces; ++face)
+                glTexImage2D(faces == 6 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0,
+                             GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+            // hardware depth comparison, bilinearly filtered over 2x2 texels
+            glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+            if (faces == 6)
+            {
+                glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+            }
+            else
+            {
+                // outside the map nothing is in the way
+                const float border[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+                glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+                glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+                glTexParameterfv(target, GL_TEXTURE_BORDER_COLOR, border);
+            }
+        }
+        glBindTexture(target, 0);
+    }
+
+    void placePointMap(Map& map, const glm::vec3& position)
+    {
+        allocate(map, 6, CUBE_SIZE);
+        // far enough to reach every corner of the static scene
+        float cubeFar = 2.0f * CUBE_NEAR;
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            glm::vec3 point((corner & 1) ? staticBounds.max.x : staticBounds.min.x, (corner & 2) ? staticBounds.max.y : staticBounds.min.y,
+                            (corner & 4) ? staticBounds.max.z : staticBounds.min.z);
+            cubeFar = std::max(cubeFar, glm::length(point - position));
+        }
+        map.farPlane = cubeFar;
+        map.lightPosition = glm::vec4(position, cubeFar);
+
+        // the usual cube map face orientations, +X -X +Y -Y +Z -Z
+        static const glm::vec3 directions[6] = { glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1) };
+        static const glm::vec3 ups[6] = { glm::vec3(0, -1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1), glm::vec3(0, -1, 0), glm::vec3(0, -1, 0) };
+        glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, CUBE_NEAR, cubeFar);
+        for (int face = 0; face < 6; ++face)
+        {
+            map.faceMatrices[face] = projection * glm::lookAt(position, position + directions[face], ups[face]);
+            map.frustums[face] = Frustum::fromMatrix(map.faceMatrices[face]);
+        }
+    }
+
+    void placeDirectionalMap(Map& map, const glm::vec3& direction)
+    {
+        allocate(map, 1, DIRECTIONAL_SIZE);
+        // an orthographic box around the bounding sphere of the static scene
+        glm::vec3 center = staticBounds.center();
+        float radius = std::max(0.5f * glm::length(staticBounds.max - staticBounds.min), 0.1f);
+        glm::vec3 toward = glm::normalize(direction);
+        glm::vec3 up = std::abs(toward.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 view = glm::lookAt(center - 2.0f * radius * toward, center, up);
+        glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, radius, 3.0f * radius);
+        map.faceMatrices[0] = projection * view;
+        map.frustums[0] = Frustum::fromMatrix(map.faceMatrices[0]);
+
+        // clip space to texture coordinates, with the compared depth pulled
+        // two texels' worth of distance toward the light against acne
+        map.texel = 2.0f * radius / DIRECTIONAL_SIZE;
+        float bias = 2.0f * map.texel / (2.0f * radius);
+        glm::mat4 toTexture = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f, 0.5f, 0.5f - bias)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
+        map.shadowMatrix = toTexture * map.faceMatrices[0];
+        map.lightPosition = glm::vec4(0.0f);
+    }
+
+    // render every static caster into the static copy; fixtureLight, if
+    // given, leaves out the casters around that point light
+    void renderStatic(const SceneGraph& scene, MergedGeometry& shell, Map& map, const glm::vec3* fixtureLight)
+    {
+        mergedCasters.clear();
+        for (int node : mergedNodes)
+            if (!fixtureLight || !isFixture(scene, node, *fixtureLight))
+                mergedCasters.push_back(node);
+        for (int mesh = 0; mesh < MESHES; ++mesh)
+        {
+            staticCasters[mesh]->begin();
+            for (int node : staticNodes[mesh])
+                if (!fixtureLight || !isFixture(scene, node, *fixtureLight))
+                    staticCasters[mesh]->add(scene.instance(node));
+            staticCasters[mesh]->upload(GL_STATIC_DRAW);
+        }
+
+        glViewport(0, 0, map.size, map.size);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+        depthShader.set(lightPositionUniform, map.lightPosition);
+        for (int face = 0; face < map.faces; ++face)
+        {
+            attach(GL_DRAW_FRAMEBUFFER, map, map.staticDepth, face);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            depthShader.set(lightSpaceUniform, map.faceMatrices[face]);
+            shell.draw(mergedCasters);
+            for (int mesh = 0; mesh < MESHES; ++mesh)
+                staticCasters[mesh]->draw();
+        }
+        map.built = true;
+        map.stale = (1u << map.faces) - 1;
+        ++totals.staticRenders;
+    }
+
+    // refresh the frame copy: static depth where the dynamic casters were,
+    // then the dynamic casters where they are now
+    void composite(Map& map)
+    {
+        unsigned int touched = 0;
+        for (int face = 0; face < map.faces; ++face)
+        {
+            for (const AABB& box : dynamicBoxes)
+            {
+                unsigned int planeMask = 0x3f;
+                if (map.frustums[face].classify(box, planeMask) != Frustum::OUTSIDE)
+                {
+                    touched |= 1u << face;
+                    break;
+                }
+            }
+        }
+
+        unsigned int restore = touched | map.lastTouched | map.stale;
+        if (restore)
+        {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+            for (int face = 0; face < map.faces; ++face)
+            {
+                if (!(restore & (1u << face)))
+                    continue;
+                attach(GL_READ_FRAMEBUFFER, map, map.staticDepth, face);
+                attach(GL_DRAW_FRAMEBUFFER, map, map.frameDepth, face);
+                glBlitFramebuffer(0, 0, map.size, map.size, 0, 0, map.size, map.size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            }
+        }
+        if (touched)
+        {
+            if (!dynamicUploaded)
+            {
+                for (int mesh = 0; mesh < MESHES; ++mesh)
+                    dynamicCasters[mesh]->upload();
+                dynamicUploaded = true;
+            }
+            depthShader.set(lightPositionUniform, map.lightPosition);
+            glViewport(0, 0, map.size, map.size);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+            for (int face = 0; face < map.faces; ++face)
+            {
+                if (!(touched & (1u << face)))
+                    continue;
+                attach(GL_DRAW_FRAMEBUFFER, map, map.frameDepth, face);
+                depthShader.set(lightSpaceUniform, map.faceMatrices[face]);
+                for (int mesh = 0; mesh < MESHES; ++mesh)
+                    dynamicCasters[mesh]->draw();
+                ++totals.compositedFaces;
+            }
+        }
+        map.lastTouched = touched;
+        map.stale = 0;
+    }
+
+    void attach(GLenum framebuffer, const Map& map, GLuint texture, int face) const
+    {
+        GLenum target = map.faces == 6 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : GL_TEXTURE_2D;
+        glFramebufferTexture2D(framebuffer, GL_DEPTH_ATTACHMENT, target, texture, 0);
+    }
+
+    // whether a static caster belongs to the housing of the light at position
+    static bool isFixture(const SceneGraph& scene, int node, const glm::vec3& position)
+    {
+        AABB box = AABB::fromUnitCube(scene.world[node]);
+        glm::vec3 nearest = glm::max(box.min, glm::min(position, box.max));
+        return glm::length(nearest - position) < FIXTURE_RADIUS;
+    }
+};
+
+#endif
@@ -0,0 +1,259 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "camera.h"
+#include "tripleBuffer.h"
+
+// Everything the restaurant simulates: where the camera is, how far the fan
+// has turned and which light switches are set
+struct SimulationState
+{
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    float cameraYaw = YAW;
+    float cameraPitch = PITCH;
+    float cameraZoom = ZOOM;
+    float fanAngle = 0.0f; // degrees
+    bool fanSpinning = false;
+    // switches flipped by B/N (the directional light) and C/V, 1/2, 3/4 and 5/6
+    // (every point light in the scene), matching the lights' defaults
+    bool directionalLight = false;
+    bool pointLights = true;
+    bool ambient = true;
+    bool diffuse = true;
+    bool specular = true;
+};
+
+// The last two ticks, so the renderer can draw any moment in between
+struct SimulationSnapshot
+{
+    SimulationState previous, current;
+    unsigned long long tick = 0;
+    double time = 0.0; // when current was simulated, in seconds since the Simulation was created
+};
+
+// Fixed-timestep simulation of the camera, the fan and the light switches.
+// start() runs it on its own thread at a steady tick rate, independent of the
+// frame rate; input is handed over from the window thread and every tick
+// publishes a snapshot through a triple buffer. The renderer only ever reads
+// snapshots, interpolating between the last two ticks so motion stays smooth
+// at any frame rate. Without start(), step() advances it one tick directly.
+class Simulation
+{
+public:
+    Simulation(const Camera& camera, const SimulationState& initial, double tickSeconds)
+        : camera(camera), state(initial), tickSeconds(tickSeconds), epoch(Clock::now()),
+          snapshots(initialSnapshot(initial))
+    {
+        this->camera.Position = initial.cameraPosition;
+        this->camera.Yaw = initial.cameraYaw;
+        this->camera.Pitch = initial.cameraPitch;
+        this->camera.Zoom = initial.cameraZoom;
+        this->camera.ProcessMouseMovement(0.0f, 0.0f); // recompute Front/Right/Up
+    }
+
+    ~Simulation()
+    {
+        stop();
+    }
+
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+
+    void start()
+    {
+        if (thread.joinable())
+            return;
+        running = true;
+        thread = std::thread(&Simulation::run, this);
+    }
+
+    void stop()
+    {
+        running = false;
+        if (thread.joinable())
+            thread.join();
+    }
+
+    // input, from the thread that polls the window
+
+    // camera movements held down, as bits 1 << Camera_Movement
+    void setHeldMoves(unsigned int moves)
+    {
+        heldMoves.store(moves, std::memory_order_relaxed);
+    }
+
+    void keyPressed(int key)
+    {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        pressedKeys.push_back(key);
+    }
+
+    void mouseMoved(float xoffset, float yoffset)
+    {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        mouseX += xoffset;
+        mouseY += yoffset;
+    }
+
+    void scrolled(float yoffset)
+    {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        scroll += yoffset;
+    }
+
+    // advance one tick and publish it; only the simulation thread calls this
+    // once start() has been called
+    void step()
+    {
+        SimulationSnapshot& snapshot = snapshots.back();
+        snapshot.previous = state;
+
+        std::vector<int> keys;
+        float moveX, moveY, zoom;
+        {
+            std::lock_guard<std::mutex> lock(inputMutex);
+            keys.swap(pressedKeys);
+            moveX = mouseX;
+            moveY = mouseY;
+            zoom = scroll;
+            mouseX = mouseY = scroll = 0.0f;
+        }
+        for (int key : keys)
+            applyKey(key);
+
+        float dt = static_cast<float>(tickSeconds);
+        if (moveX != 0.0f || moveY != 0.0f)
+            camera.ProcessMouseMovement(moveX, moveY);
+        if (zoom != 0.0f)
+            camera.ProcessMouseScroll(zoom);
+        unsigned int moves = heldMoves.load(std::memory_order_relaxed);
+        for (int direction = FORWARD; direction <= DOWN; ++direction)
+            if (moves & (1u << direction))
+                camera.ProcessKeyboard(static_cast<Camera_Movement>(direction), dt);
+        state.cameraPosition = camera.Position;
+        state.cameraYaw = camera.Yaw;
+        state.cameraPitch = camera.Pitch;
+        state.cameraZoom = camera.Zoom;
+
+        if (state.fanSpinning)
+        {
+            state.fanAngle += 700.0f * dt; // Rotation speed
+            if (state.fanAngle >= 360.0f) state.fanAngle = 0.0f; // Keep angle within 360 degrees
+        }
+
+        snapshot.current = state;
+        snapshot.tick = ++ticks;
+        snapshot.time = secondsSinceEpoch();
+        snapshots.publish();
+    }
+
+    // renderer: the newest snapshot
+    const SimulationSnapshot& latest()
+    {
+        snapshots.update();
+        return snapshots.front();
+    }
+
+    // renderer: the state one tick behind now, blended between the last two
+    // ticks; lags the simulation by at most a tick
+    SimulationState interpolated()
+    {
+        const SimulationSnapshot& snapshot = latest();
+        float t = static_cast<float>((secondsSinceEpoch() - snapshot.time) / tickSeconds);
+        return blend(snapshot.previous, snapshot.current, std::min(std::max(t, 0.0f), 1.0f));
+    }
+
+    double tickLength() const
+    {
+        return tickSeconds;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    Camera camera;
+    SimulationState state;
+    double tickSeconds;
+    Clock::time_point epoch;
+    unsigned long long ticks = 0;
+    TripleBuffer<SimulationSnapshot> snapshots;
+
+    std::thread thread;
+    std::atomic<bool> running{ false };
+
+    std::atomic<unsigned int> heldMoves{ 0 };
+    std::mutex inputMutex;
+    std::vector<int> pressedKeys;
+    float mouseX = 0.0f, mouseY = 0.0f, scroll = 0.0f;
+
+    static SimulationSnapshot initialSnapshot(const SimulationState& initial)
+    {
+        SimulationSnapshot snapshot;
+        snapshot.previous = snapshot.current = initial;
+        return snapshot;
+    }
+
+    double secondsSinceEpoch() const
+    {
+        return std::chrono::duration<double>(Clock::now() - epoch).count();
+    }
+
+    void run()
+    {
+        Clock::duration tick = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(tickSeconds));
+        Clock::time_point next = Clock::now();
+        while (running)
+        {
+            step();
+            next += tick;
+            Clock::time_point now = Clock::now();
+            if (now - next > 8 * tick)
+                next = now; // fell far behind (e.g. stopped in a debugger); don't try to catch up
+            std::this_thread::sleep_until(next);
+        }
+    }
+
+    void applyKey(int key)
+    {
+        // Light Controls
+        if (key == GLFW_KEY_B) state.directionalLight = true;
+        else if (key == GLFW_KEY_N) state.directionalLight = false;
+        if (key == GLFW_KEY_C) state.pointLights = true;
+        else if (key == GLFW_KEY_V) state.pointLights = false;
+        if (key == GLFW_KEY_1) state.ambient = true;
+        else if (key == GLFW_KEY_2) state.ambient = false;
+        if (key == GLFW_KEY_3) state.diffuse = true;
+        else if (key == GLFW_KEY_4) state.diffuse = false;
+        if (key == GLFW_KEY_5) state.specular = true;
+        else if (key == GLFW_KEY_6) state.specular = false;
+
+        // Ceiling Fan Controls
+        if (key == GLFW_KEY_J) state.fanSpinning = true;
+        else if (key == GLFW_KEY_K) state.fanSpinning = false;
+    }
+
+    static SimulationState blend(const SimulationState& a, const SimulationState& b, float t)
+    {
+        SimulationState result = b;
+        result.cameraPosition = glm::mix(a.cameraPosition, b.cameraPosition, t);
+        result.cameraYaw = glm::mix(a.cameraYaw, b.cameraYaw, t);
+        result.cameraPitch = glm::mix(a.cameraPitch, b.cameraPitch, t);
+        result.cameraZoom = glm::mix(a.cameraZoom, b.cameraZoom, t);
+        float fanEnd = b.fanAngle < a.fanAngle ? b.fanAngle + 360.0f : b.fanAngle; // wrapped past 360
+        result.fanAngle = glm::mix(a.fanAngle, fanEnd, t);
+        if (result.fanAngle >= 360.0f) result.fanAngle -= 360.0f;
+        return result;
+    }
+};
+
+#endif
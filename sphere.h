@@ -3,94 +3,113 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <cfloat>
+#include <cmath>
 #include <vector>
-#include "shader.h"
-
-
-class Sphere {
-public:
-    unsigned int VAO, VBO, EBO;
-    std::vector<float> vertices;
-    std::vector<unsigned int> indices;
-
-    Sphere(float radius = 1.0f, int sectorCount = 36, int stackCount = 18) {
-        generateSphere(radius, sectorCount, stackCount);
-        setupMesh();
+#include "meshBuffer.h"
+
+
+// append a sphere to interleaved position/normal vertices; indices are
+// offset past the vertices already in the array
+inline void generateSphere(float radius, int sectorCount, int stackCount, std::vector<float>& vertices, std::vector<unsigned int>& indices) {
+    const float PI = 3.14159265358979323846f;
+    unsigned int base = static_cast<unsigned int>(vertices.size() / 6);
+    for (int i = 0; i <= stackCount; ++i) {
+        float stackAngle = PI / 2 - i * PI / stackCount; // From pi/2 to -pi/2
+        float xy = radius * cosf(stackAngle);
+        float z = radius * sinf(stackAngle);
+
+        for (int j = 0; j <= sectorCount; ++j) {
+            float sectorAngle = j * 2 * PI / sectorCount;
+
+            float x = xy * cosf(sectorAngle);
+            float y = xy * sinf(sectorAngle);
+            vertices.push_back(x);
+            vertices.push_back(y);
+            vertices.push_back(z);
+
+            float nx = x / radius;
+            float ny = y / radius;
+            float nz = z / radius;
+            vertices.push_back(nx);
+            vertices.push_back(ny);
+            vertices.push_back(nz);
+        }
     }
 
-    void draw(Shader& shader, glm::mat4 model) {
-        shader.use();
-        shader.setMat4("model", model);
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-    }
+    for (int i = 0; i < stackCount; ++i) {
+        unsigned int k1 = base + i * (sectorCount + 1);
+        unsigned int k2 = k1 + sectorCount + 1;
 
-private:
-    void generateSphere(float radius, int sectorCount, int stackCount) {
-        const float PI = 3.14159265358979323846f;
-        for (int i = 0; i <= stackCount; ++i) {
-            float stackAngle = PI / 2 - i * PI / stackCount; // From pi/2 to -pi/2
-            float xy = radius * cosf(stackAngle);
-            float z = radius * sinf(stackAngle);
-
-            for (int j = 0; j <= sectorCount; ++j) {
-                float sectorAngle = j * 2 * PI / sectorCount;
-
-                float x = xy * cosf(sectorAngle);
-                float y = xy * sinf(sectorAngle);
-                vertices.push_back(x);
-                vertices.push_back(y);
-                vertices.push_back(z);
-
-                float nx = x / radius;
-                float ny = y / radius;
-                float nz = z / radius;
-                vertices.push_back(nx);
-                vertices.push_back(ny);
-                vertices.push_back(nz);
+        for (int j = 0; j < sectorCount; ++j, ++k1, ++k2) {
+            if (i != 0) {
+                indices.push_back(k1);
+                indices.push_back(k2);
+                indices.push_back(k1 + 1);
             }
-        }
-
-        for (int i = 0; i < stackCount; ++i) {
-            int k1 = i * (sectorCount + 1);
-            int k2 = k1 + sectorCount + 1;
-
-            for (int j = 0; j < sectorCount; ++j, ++k1, ++k2) {
-                if (i != 0) {
-                    indices.push_back(k1);
-                    indices.push_back(k2);
-                    indices.push_back(k1 + 1);
-                }
-                if (i != (stackCount - 1)) {
-                    indices.push_back(k1 + 1);
-                    indices.push_back(k2);
-                    indices.push_back(k2 + 1);
-                }
+            if (i != (stackCount - 1)) {
+                indices.push_back(k1 + 1);
+                indices.push_back(k2);
+                indices.push_back(k2 + 1);
             }
         }
     }
+}
 
-    void setupMesh() {
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
 
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
+// A chain of spheres of increasing detail (8, 16, 32 and 64 sectors) in one
+// shared MeshBuffer, each level a range of the index buffer. The radius is 0.5,
+// so a sphere fills the unit cube like the cube mesh does and can be placed
+// and culled the same way. select() picks the coarsest level that still
+// looks round at the sphere's projected size.
+class SphereLODs {
+public:
+    static const int LEVELS = 4;
+
+    struct Level {
+        int sectors;
+        GLsizei indexCount;
+        GLsizei firstIndex;
+    };
+
+    MeshBuffer mesh;
+    Level levels[LEVELS];
+
+    // silhouette error allowed before switching to the next level
+    static constexpr float TOLERANCE_PIXELS = 0.5f;
+
+    explicit SphereLODs(bool allowPacked = true) {
+        std::vector<float> vertices;
+        std::vector<unsigned int> indices;
+        for (int level = 0; level < LEVELS; ++level) {
+            int sectors = 8 << level;
+            levels[level].sectors = sectors;
+            levels[level].firstIndex = static_cast<GLsizei>(indices.size());
+            generateSphere(0.5f, sectors, sectors / 2, vertices, indices);
+            levels[level].indexCount = static_cast<GLsizei>(indices.size()) - levels[level].firstIndex;
+        }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        mesh.upload(vertices, indices, allowPacked);
+    }
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
+    SphereLODs(const SphereLODs&) = delete;
+    SphereLODs& operator=(const SphereLODs&) = delete;
 
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(1);
+    // largest on-screen radius a level is used for: a chord spanning
+    // 2*pi/sectors dips r * (1 - cos(pi/sectors)) inside the true outline
+    static float maxRadiusPixels(int level) {
+        const float PI = 3.14159265358979323846f;
+        if (level >= LEVELS - 1)
+            return FLT_MAX;
+        return TOLERANCE_PIXELS / (1.0f - cosf(PI / (8 << level)));
+    }
 
-        glBindVertexArray(0);
+    // level for a sphere covering radiusPixels on screen
+    static int select(float radiusPixels) {
+        int level = 0;
+        while (level < LEVELS - 1 && radiusPixels > maxRadiusPixels(level))
+            ++level;
+        return level;
     }
 };
 
@@ -0,0 +1,179 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <glad/glad.h>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "glExtensions.h"
+
+// A buffer for data that is rewritten every frame, such as instance
+// transforms. With GL 4.4 / ARB_buffer_storage it is allocated once as three
+// partitions and stays persistently mapped: each upload goes to the next
+// partition with a plain memcpy, and a fence placed after the draws that read
+// a partition tells the CPU when it may write there again. Three frames in
+// flight means that wait should never happen; every time it does, it is
+// counted in stats(). On GL 3.3 it falls back to orphaning, i.e.
+// glBufferData(NULL) followed by glBufferSubData, which leaves the
+// synchronization to the driver (and the stall count at zero). A buffer whose
+// persistent mapping fails falls back to orphaning as well.
+class StreamBuffer
+{
+public:
+    static const int PARTITIONS = 3;
+
+    // summed over every stream buffer
+    struct Stats
+    {
+        unsigned long long uploads = 0;
+        unsigned long long stalls = 0;     // uploads that had to wait for the GPU
+        double stallMilliseconds = 0.0;
+    };
+
+    explicit StreamBuffer(GLenum target)
+        : target(target), persistent(GLExtensions::get().bufferStorage && !orphaningForced())
+    {
+        glGenBuffers(1, &id);
+    }
+
+    ~StreamBuffer()
+    {
+        release();
+        glDeleteBuffers(1, &id);
+    }
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    // the buffer object; may change when an upload outgrows it
+    GLuint buffer() const
+    {
+        return id;
+    }
+
+    bool isPersistent() const
+    {
+        return persistent;
+    }
+
+    // copy bytes into the next partition, leaving the buffer bound to target;
+    // returns the partition's offset in buffer()
+    size_t upload(const void* data, size_t bytes)
+    {
+        ++stats().uploads;
+        if (persistent && bytes > capacity)
+            allocate(bytes * 2);
+        glBindBuffer(target, id);
+        if (!persistent)
+        {
+            if (bytes > capacity)
+                capacity = bytes * 2;
+            // orphan the previous storage so the driver doesn't wait on last frame's draw
+            glBufferData(target, capacity, nullptr, GL_STREAM_DRAW);
+            glBufferSubData(target, 0, bytes, data);
+            return 0;
+        }
+
+        current = (current + 1) % PARTITIONS;
+        waitFor(current);
+        size_t offset = current * capacity;
+        std::memcpy(mapped + offset, data, bytes);
+        return offset;
+    }
+
+    // call after issuing the draws that read the last upload
+    void fence()
+    {
+        if (!persistent || !mapped)
+            return;
+        if (fences[current])
+            glDeleteSync(fences[current]);
+        fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    static Stats& stats()
+    {
+        static Stats totals;
+        return totals;
+    }
+
+    // --orphan-streaming: use the GL 3.3 path even where persistent mapping
+    // is available, for comparison; set before creating any stream buffer
+    static bool& orphaningForced()
+    {
+        static bool forced = false;
+        return forced;
+    }
+
+private:
+    GLenum target;
+    bool persistent;
+    GLuint id = 0;
+    size_t capacity = 0; // bytes per partition, or of the whole buffer when orphaning
+    char* mapped = nullptr;
+    int current = 0;
+    GLsync fences[PARTITIONS] = {};
+
+    // new immutable storage of three partitions; the old buffer object is
+    // freed by the driver once the GPU is done with it. If it can't be
+    // mapped, the buffer is replaced by an empty one for orphaning.
+    void allocate(size_t partitionBytes)
+    {
+        release();
+        glDeleteBuffers(1, &id);
+        glGenBuffers(1, &id);
+        capacity = (partitionBytes + 255) & ~size_t(255); // keep every partition aligned
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBindBuffer(target, id);
+        GLExtensions::get().bufferStorageFrom(target, capacity * PARTITIONS, nullptr, flags);
+        mapped = static_cast<char*>(glMapBufferRange(target, 0, capacity * PARTITIONS, flags));
+        current = 0;
+        if (!mapped)
+        {
+            std::cout << "Persistent mapping of a stream buffer failed, orphaning instead" << std::endl;
+            glDeleteBuffers(1, &id); // immutable storage can't be orphaned
+            glGenBuffers(1, &id);
+            persistent = false;
+            capacity = 0;
+        }
+    }
+
+    void release()
+    {
+        for (GLsync& fence : fences)
+        {
+            if (fence)
+                glDeleteSync(fence);
+            fence = 0;
+        }
+        if (mapped)
+        {
+            glBindBuffer(target, id);
+            glUnmapBuffer(target);
+            mapped = nullptr;
+        }
+    }
+
+    void waitFor(int partition)
+    {
+        GLsync fence = fences[partition];
+        if (!fence)
+            return;
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED)
+        {
+            std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+            do
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1 ms
+            while (status == GL_TIMEOUT_EXPIRED);
+            Stats& totals = stats();
+            ++totals.stalls;
+            totals.stallMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        }
+        glDeleteSync(fence);
+        fences[partition] = 0;
+    }
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// Hands the newest value from one producer thread to one consumer thread
+// without locks or waiting. The producer fills back() and publish()es it;
+// the consumer calls update() and reads front(). The third slot sits between
+// them, so neither side ever touches the slot the other is using, and a
+// consumer that falls behind simply skips to the newest value.
+template <typename T>
+class TripleBuffer
+{
+public:
+    explicit TripleBuffer(const T& initial = T())
+    {
+        for (Slot& slot : slots)
+            slot.value = initial;
+    }
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // producer: the slot to write next
+    T& back()
+    {
+        return slots[backIndex].value;
+    }
+
+    // producer: make back() the newest value and start on another slot
+    void publish()
+    {
+        backIndex = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // consumer: switch front() to the newest value; false if nothing was
+    // published since the last call
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    // consumer: the value taken by the last update()
+    const T& front() const
+    {
+        return slots[frontIndex].value;
+    }
+
+private:
+    enum { INDEX = 3, FRESH = 4 };
+
+    // a cache line each, so the two threads don't false-share
+    struct alignas(64) Slot
+    {
+        T value;
+    };
+
+    Slot slots[3];
+    alignas(64) std::atomic<unsigned int> middle{ 1 };
+    alignas(64) unsigned int backIndex = 0; // producer only
+    alignas(64) unsigned int frontIndex = 2; // consumer only
+};
+
+#endif
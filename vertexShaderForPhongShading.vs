@@ -2,18 +2,40 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 
+// per-instance attributes; everything is drawn instanced
+layout (location = 2) in mat4 aInstanceModel;
+layout (location = 6) in uint aInstanceMaterial;
+layout (location = 7) in mat3 aInstanceNormalMatrix;
+// ambient + diffuse light baked into the merged static geometry (mergedGeometry.h)
+layout (location = 10) in vec3 aBakedLight;
+
 out vec3 FragPos;
 out vec3 Normal;
+out float ViewDepth; // positive distance along the view axis, picks the light cluster
+out vec3 BakedLight;
+flat out vec4 MaterialAmbientShininess;
+flat out vec3 MaterialDiffuse;
+flat out vec3 MaterialSpecular;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// Material table, three texels per material (see MaterialTexels in materialLibrary.h)
+uniform samplerBuffer materialData;
+
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    vec4 worldPos = aInstanceModel * vec4(aPos, 1.0);
+    vec4 viewPos = view * worldPos;
+    gl_Position = projection * viewPos;
     
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    FragPos = vec3(worldPos);
+    ViewDepth = -viewPos.z;
+    Normal = aInstanceNormalMatrix * aNormal;
+    BakedLight = aBakedLight;
+    int material = 3 * int(aInstanceMaterial);
+    MaterialAmbientShininess = texelFetch(materialData, material);
+    MaterialDiffuse = texelFetch(materialData, material + 1).rgb;
+    MaterialSpecular = texelFetch(materialData, material + 2).rgb;
     
 }